@@ -1,5 +1,11 @@
 // MOS 6502 clock-accurate emulator.
+#include <stdio.h>
+#include <string.h>
 #include "6502.h"
+#include "ROM2364.h"
+#ifdef LOCKSTEP
+#include "LOCKSTEP.h"
+#endif
 
 // Basic logic
 #define BIT(n)     ( (n) & 1 )
@@ -12,12 +18,16 @@ void Step6502 (M6502 *cpu)
     // Top part context.
     #define PHI1    (cpu->PHI1)
     #define PHI2    (cpu->PHI2)
-
-    static  unsigned char IR;
-    static  char TWOCYCLE_Latch, TRESX_Latch, TRES1_Latch;
-    static  char ReadyOut_Latch, ReadyIn_Latch;
-    static  char T0_Latch, T1_Latch;
-    static  char TX_Input[4], TX_Output[4];     // long (extended) cycle counter
+    #define IR      (cpu->IR)
+    #define TWOCYCLE_Latch  (cpu->TWOCYCLE_Latch)
+    #define TRESX_Latch     (cpu->TRESX_Latch)
+    #define TRES1_Latch     (cpu->TRES1_Latch)
+    #define ReadyOut_Latch  (cpu->ReadyOut_Latch)
+    #define ReadyIn_Latch   (cpu->ReadyIn_Latch)
+    #define T0_Latch        (cpu->T0_Latch)
+    #define T1_Latch        (cpu->T1_Latch)
+    #define TX_Input        (cpu->TX_Input)
+    #define TX_Output       (cpu->TX_Output)
     int     p;
     int     ready, nready;
     int     nT0, T0, nT1X, nT2, nT3, nT4, nT5;
@@ -58,20 +68,55 @@ void Step6502 (M6502 *cpu)
     printf ( "PHI:%i, T: %i%i%i%i%i%i, ready:%i\n", cpu->PHI0, nT0, nT1X, nT2, nT3, nT4, nT5, ready );
 }
 
+// Program ROM at $E000-$FFFF: NOPs, reset vector to $E000.
+static unsigned char program[ROM2364_SIZE];
+
 // Execute 1000 cycles.
+// Built with LOCKSTEP, every half-cycle is also checked against reference Step6502 on checker thread
+// (replace Step6502 call below with optimized core to verify it).
 main ()
 {
     M6502 cpu;
+    Context2364 rom;
     int cycles = 0;
+#ifdef LOCKSTEP
+    static ContextLockstep ls;
+    LockstepReference ref;
+    M6502 slow;
+#endif
 
     memset ( &cpu, 0, sizeof(M6502));
 
     cpu.RDY = 1;
     cpu.nNMI = cpu.nIRQ = cpu.nRES = 1;
 
+    memset ( program, 0xea, sizeof(program) );
+    program[0x1ffd] = 0xe0;
+    memset ( &rom, 0, sizeof(rom) );
+    Map2364 ( &rom, program, sizeof(program) );
+
+#ifdef LOCKSTEP
+    slow = cpu;
+    LockstepRef6502 (&ref, &slow);
+    if ( !LockstepStart (&ls, &ref, NULL) ) return 1;
+#endif
+
     while (cycles++ < 1000)
     {
+        if (cpu.PHI0 && cpu.RW) {       // ROM drives data bus during PHI2 read
+            rom.A = cpu.ADDR & 0x1fff;
+            rom.CS = (cpu.ADDR & 0xe000) != 0xe000;
+            Step2364Word (&rom);
+            cpu.DATA = rom.D;
+        }
         Step6502 (&cpu);
+#ifdef LOCKSTEP
+        if ( !LockstepPush (&ls, &cpu) ) break;
+#endif
         cpu.PHI0 ^= 1;
     }
+
+#ifdef LOCKSTEP
+    return LockstepStop (&ls);
+#endif
 }
\ No newline at end of file
@@ -1,3 +1,5 @@
+#pragma once
+
 typedef struct M6502 {
     char nNMI;
     char nIRQ;
@@ -11,6 +13,13 @@ typedef struct M6502 {
     unsigned char DATA;
     unsigned short ADDR;
     char SYNC;
+
+    // Internal latches, per core: lockstep runs reference next to core under test.
+    unsigned char IR;
+    char TWOCYCLE_Latch, TRESX_Latch, TRES1_Latch;
+    char ReadyOut_Latch, ReadyIn_Latch;
+    char T0_Latch, T1_Latch;
+    char TX_Input[4], TX_Output[4];     // long (extended) cycle counter
 } M6502;
 
 void Step6502 (M6502 *cpu);
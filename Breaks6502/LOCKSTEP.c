@@ -0,0 +1,243 @@
+// Lockstep differential checker.
+// Fast core only does LockstepPush per half-cycle. Checker thread runs reference core with same inputs
+// and compares outputs. On first divergence checker goes on for LOCKSTEP_AFTER records, then both cores
+// are stopped and window of records around divergence is dumped, with reference internal nets of each.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "LOCKSTEP.h"
+#include "../BreaksCommon/ATOMIC.h"
+
+#ifdef _WIN32
+#define YIELD()             Sleep (0)
+#else
+#include <pthread.h>
+#include <sched.h>
+#define YIELD()             sched_yield ()
+#endif
+
+#define QUEUE_MASK  (LOCKSTEP_QUEUE - 1)
+#define WINDOW(n)   ((n) % LOCKSTEP_WINDOW)
+
+void LockstepPack (M6502 *cpu, LockstepRecord *rec)
+{
+    int pads = 0;
+
+    if (cpu->PHI0) pads |= LOCKSTEP_PHI0;
+    if (cpu->PHI1) pads |= LOCKSTEP_PHI1;
+    if (cpu->PHI2) pads |= LOCKSTEP_PHI2;
+    if (cpu->nNMI) pads |= LOCKSTEP_nNMI;
+    if (cpu->nIRQ) pads |= LOCKSTEP_nIRQ;
+    if (cpu->nRES) pads |= LOCKSTEP_nRES;
+    if (cpu->RDY) pads |= LOCKSTEP_RDY;
+    if (cpu->SO) pads |= LOCKSTEP_SO;
+    if (cpu->RW) pads |= LOCKSTEP_RW;
+    if (cpu->SYNC) pads |= LOCKSTEP_SYNC;
+
+    rec->pads = pads;
+    rec->ADDR = cpu->ADDR;
+    rec->DATA = cpu->DATA;
+}
+
+// ------------------------------------------------------------------------
+// Fast core side (producer)
+
+int LockstepPush (ContextLockstep *ls, M6502 *cpu)
+{
+    unsigned long head = ls->head;
+    LockstepRecord *rec;
+
+    // Queue full: wait for checker to catch up.
+    while ( (head - ATOMIC_LOAD(&ls->tail)) >= LOCKSTEP_QUEUE ) {
+        if (ls->stop) return 0;
+        YIELD ();
+    }
+    if (ls->stop) return 0;
+
+    rec = &ls->queue[head & QUEUE_MASK];
+    LockstepPack (cpu, rec);
+    rec->cycle = ls->cycle++;
+    ATOMIC_STORE (&ls->head, head + 1);
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+// Checker side (consumer)
+
+static int Mismatch (LockstepRecord *fast, LockstepRecord *slow)
+{
+    if ( (fast->pads ^ slow->pads) & LOCKSTEP_OUTPUTS ) return 1;
+    if ( fast->ADDR != slow->ADDR ) return 1;
+    if ( !(fast->pads & LOCKSTEP_RW) && fast->DATA != slow->DATA ) return 1;   // data is output only during write
+    return 0;
+}
+
+static void DumpRecord (FILE *f, char *who, LockstepRecord *rec)
+{
+    fprintf ( f, "%s %8lu: PHI0:%i PHI1:%i PHI2:%i /NMI:%i /IRQ:%i /RES:%i RDY:%i SO:%i R/W:%i SYNC:%i A:%04X D:%02X\n", who, rec->cycle,
+        (rec->pads & LOCKSTEP_PHI0) != 0, (rec->pads & LOCKSTEP_PHI1) != 0, (rec->pads & LOCKSTEP_PHI2) != 0,
+        (rec->pads & LOCKSTEP_nNMI) != 0, (rec->pads & LOCKSTEP_nIRQ) != 0, (rec->pads & LOCKSTEP_nRES) != 0,
+        (rec->pads & LOCKSTEP_RDY) != 0, (rec->pads & LOCKSTEP_SO) != 0,
+        (rec->pads & LOCKSTEP_RW) != 0, (rec->pads & LOCKSTEP_SYNC) != 0, rec->ADDR, rec->DATA );
+}
+
+// Window ends with last record checked (up to LOCKSTEP_AFTER past divergence).
+static void DumpDivergence (ContextLockstep *ls)
+{
+    FILE *f = ls->log ? ls->log : stdout;
+    unsigned long n, first;
+
+    fprintf ( f, "Lockstep divergence at half-cycle %lu\n", ls->diverged[0].cycle );
+    first = ls->checked >= LOCKSTEP_WINDOW ? ls->checked - LOCKSTEP_WINDOW : 0;
+    for (n=first; n<ls->checked; n++) {
+        if ( n == ls->divergence ) fprintf ( f, "-- first divergence --\n" );
+        DumpRecord ( f, "fast", &ls->fast[WINDOW(n)] );
+        DumpRecord ( f, "ref ", &ls->slow[WINDOW(n)] );
+        if ( ls->nets && ls->ref.dump ) {
+            fprintf ( f, "     nets: " );
+            ls->ref.dump (ls->nets + WINDOW(n) * ls->ref.size, f);
+        }
+    }
+    fflush (f);
+}
+
+// Fast core is not held back after divergence: it keeps pushing until window after divergence is filled.
+static void Checker (ContextLockstep *ls)
+{
+    unsigned long tail = ls->tail;
+    LockstepRecord fast, slow;
+    int diverged = 0;
+
+    while (1) {
+        if ( tail == ATOMIC_LOAD(&ls->head) ) {
+            if ( ATOMIC_LOAD(&ls->done) && tail == ATOMIC_LOAD(&ls->head) ) break;
+            YIELD ();
+            continue;
+        }
+
+        fast = ls->queue[tail & QUEUE_MASK];
+        slow = fast;
+        ls->ref.step (ls->ref.ctx, &slow);
+        slow.cycle = fast.cycle;
+
+        ls->fast[WINDOW(ls->checked)] = fast;
+        ls->slow[WINDOW(ls->checked)] = slow;
+        if (ls->nets) memcpy (ls->nets + WINDOW(ls->checked) * ls->ref.size, ls->ref.ctx, ls->ref.size);
+        if ( !diverged && Mismatch (&fast, &slow) ) {
+            ls->diverged[0] = fast;
+            ls->diverged[1] = slow;
+            ls->divergence = ls->checked;
+            diverged = 1;
+        }
+        ls->checked++;
+
+        ATOMIC_STORE (&ls->tail, ++tail);
+        if ( diverged && ls->checked - ls->divergence > LOCKSTEP_AFTER ) break;
+    }
+
+    if (diverged) {
+        ATOMIC_STORE (&ls->stop, 1);
+        DumpDivergence (ls);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI CheckerThread (LPVOID arg)
+{
+    Checker ((ContextLockstep *)arg);
+    return 0;
+}
+#else
+static void * CheckerThread (void *arg)
+{
+    Checker ((ContextLockstep *)arg);
+    return NULL;
+}
+#endif
+
+int LockstepStart (ContextLockstep *ls, LockstepReference *ref, FILE *log)
+{
+    ls->head = ls->tail = 0;
+    ls->stop = ls->done = 0;
+    ls->cycle = ls->checked = ls->divergence = 0;
+    ls->ref = *ref;
+    ls->log = log;
+    ls->nets = NULL;
+    if ( ref->size ) {
+        ls->nets = (unsigned char *)calloc (LOCKSTEP_WINDOW, ref->size);
+        if ( ls->nets == NULL ) return 0;
+    }
+
+#ifdef _WIN32
+    ls->thread = CreateThread (NULL, 0, CheckerThread, ls, 0, NULL);
+    if ( ls->thread != NULL ) return 1;
+#else
+    ls->thread = malloc (sizeof(pthread_t));
+    if ( ls->thread != NULL && pthread_create ((pthread_t *)ls->thread, NULL, CheckerThread, ls) == 0 ) return 1;
+    free (ls->thread);
+    ls->thread = NULL;
+#endif
+    free (ls->nets);
+    ls->nets = NULL;
+    return 0;
+}
+
+int LockstepStop (ContextLockstep *ls)
+{
+    if (ls->thread == NULL) return ls->stop;
+
+    ATOMIC_STORE (&ls->done, 1);
+#ifdef _WIN32
+    WaitForSingleObject ((HANDLE)ls->thread, INFINITE);
+    CloseHandle ((HANDLE)ls->thread);
+#else
+    pthread_join (*(pthread_t *)ls->thread, NULL);
+    free (ls->thread);
+#endif
+    ls->thread = NULL;
+    free (ls->nets);
+    ls->nets = NULL;
+    return ls->stop;
+}
+
+// ------------------------------------------------------------------------
+// Reference: gate-level Step6502 on its own M6502 context.
+
+static void Ref6502Step (void *ctx, LockstepRecord *rec)
+{
+    M6502 *cpu = (M6502 *)ctx;
+    unsigned long cycle = rec->cycle;
+
+    cpu->PHI0 = (rec->pads & LOCKSTEP_PHI0) != 0;
+    cpu->nNMI = (rec->pads & LOCKSTEP_nNMI) != 0;
+    cpu->nIRQ = (rec->pads & LOCKSTEP_nIRQ) != 0;
+    cpu->nRES = (rec->pads & LOCKSTEP_nRES) != 0;
+    cpu->RDY = (rec->pads & LOCKSTEP_RDY) != 0;
+    cpu->SO = (rec->pads & LOCKSTEP_SO) != 0;
+    if (rec->pads & LOCKSTEP_RW) cpu->DATA = rec->DATA;     // external device drove data bus during read
+
+    Step6502 (cpu);
+
+    LockstepPack (cpu, rec);
+    rec->cycle = cycle;
+}
+
+// Internal state of M6502 (pads are in record already).
+static void Ref6502Dump (const void *ctx, FILE *f)
+{
+    const M6502 *cpu = (const M6502 *)ctx;
+
+    fprintf ( f, "IR:%02X T0:%i T1:%i TX_In:%i%i%i%i TX_Out:%i%i%i%i ReadyIn:%i ReadyOut:%i TWOCYCLE:%i TRESX:%i TRES1:%i\n",
+        cpu->IR, cpu->T0_Latch, cpu->T1_Latch,
+        cpu->TX_Input[0], cpu->TX_Input[1], cpu->TX_Input[2], cpu->TX_Input[3],
+        cpu->TX_Output[0], cpu->TX_Output[1], cpu->TX_Output[2], cpu->TX_Output[3],
+        cpu->ReadyIn_Latch, cpu->ReadyOut_Latch, cpu->TWOCYCLE_Latch, cpu->TRESX_Latch, cpu->TRES1_Latch );
+}
+
+void LockstepRef6502 (LockstepReference *ref, M6502 *cpu)
+{
+    ref->ctx = cpu;
+    ref->size = sizeof(M6502);
+    ref->step = Ref6502Step;
+    ref->dump = Ref6502Dump;
+}
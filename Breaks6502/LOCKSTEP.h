@@ -0,0 +1,81 @@
+// Lockstep differential checker.
+// Optimized core pushes pad/bus records into SPSC queue, checker thread replays them on reference core.
+#pragma once
+
+#include <stdio.h>
+#include "6502.h"
+
+// Record packed pads.
+enum {
+    LOCKSTEP_PHI0 = 0x0001,
+    LOCKSTEP_PHI1 = 0x0002,
+    LOCKSTEP_PHI2 = 0x0004,
+    LOCKSTEP_nNMI = 0x0008,
+    LOCKSTEP_nIRQ = 0x0010,
+    LOCKSTEP_nRES = 0x0020,
+    LOCKSTEP_RDY  = 0x0040,
+    LOCKSTEP_SO   = 0x0080,
+    LOCKSTEP_RW   = 0x0100,
+    LOCKSTEP_SYNC = 0x0200,
+};
+
+// Inputs are replayed into reference, outputs are compared.
+#define LOCKSTEP_INPUTS     (LOCKSTEP_PHI0 | LOCKSTEP_nNMI | LOCKSTEP_nIRQ | LOCKSTEP_nRES | LOCKSTEP_RDY | LOCKSTEP_SO)
+#define LOCKSTEP_OUTPUTS    (LOCKSTEP_PHI1 | LOCKSTEP_PHI2 | LOCKSTEP_RW | LOCKSTEP_SYNC)
+
+#define LOCKSTEP_QUEUE      (1 << 16)       // records in queue (power of 2)
+#define LOCKSTEP_WINDOW     64              // records dumped around divergence
+#define LOCKSTEP_AFTER      16              // of them after divergence
+
+// Single half-cycle record.
+typedef struct LockstepRecord
+{
+    unsigned long   cycle;      // half-cycle number
+    unsigned short  pads;       // LOCKSTEP_xxx bits
+    unsigned short  ADDR;       // address bus
+    unsigned char   DATA;       // data bus (input when RW=1, output when RW=0)
+} LockstepRecord;
+
+// Reference model. Called only from checker thread.
+// Context (size bytes) is copied after every step into window, so internal nets of each dumped record are known.
+typedef struct LockstepReference
+{
+    void    *ctx;
+    unsigned long   size;                               // context size (0: no internal nets)
+    void    (*step) (void *ctx, LockstepRecord *rec);   // apply inputs from record, step half-cycle, sample outputs back into record
+    void    (*dump) (const void *ctx, FILE *f);         // print internal nets of context copy
+} LockstepReference;
+
+typedef struct ContextLockstep
+{
+    LockstepRecord  queue[LOCKSTEP_QUEUE];
+    volatile unsigned long  head;       // written by fast core only
+    volatile unsigned long  tail;       // written by checker only
+    volatile long   stop;               // 1: divergence found, both cores must stop
+    volatile long   done;               // 1: producer finished, checker drains queue and exits
+    unsigned long   cycle;              // producer half-cycle counter
+
+    LockstepReference   ref;
+    LockstepRecord  fast[LOCKSTEP_WINDOW], slow[LOCKSTEP_WINDOW];  // history window (checker side)
+    unsigned char   *nets;              // reference contexts of window (LOCKSTEP_WINDOW * ref.size)
+    unsigned long   checked;            // records compared so far
+    unsigned long   divergence;         // record number of first divergence
+    LockstepRecord  diverged[2];        // fast/reference records at divergence
+    FILE    *log;
+    void    *thread;
+} ContextLockstep;
+
+// Pack 6502 pads into record.
+void LockstepPack (M6502 *cpu, LockstepRecord *rec);
+
+// Launch checker thread. Divergence report goes to log (stdout if NULL).
+int LockstepStart (ContextLockstep *ls, LockstepReference *ref, FILE *log);
+
+// Push current half-cycle of fast core. Returns 0 when checker stopped both cores.
+int LockstepPush (ContextLockstep *ls, M6502 *cpu);
+
+// Drain queue, stop and join checker thread. Returns 1 if divergence was found.
+int LockstepStop (ContextLockstep *ls);
+
+// Reference adapter for gate-level Step6502.
+void LockstepRef6502 (LockstepReference *ref, M6502 *cpu);
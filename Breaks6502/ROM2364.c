@@ -1,10 +1,12 @@
 // 2364 8 KB ROM simulator.
+#include <stddef.h>
 #include "ROM2364.h"
 
-// Load ROM with specific data.
-static void Load2364 (Context2364 * rom )
+int Map2364 ( Context2364 * rom, const unsigned char * data, unsigned long size )
 {
-    memset ( rom->ROM, 0, sizeof(rom->ROM) );
+    if ( data == NULL || size < ROM2364_SIZE ) return 0;
+    rom->image = data;
+    return 1;
 }
 
 void Step2364 ( Context2364 * rom )
@@ -13,17 +15,18 @@ void Step2364 ( Context2364 * rom )
     unsigned short addr = 0;
     int i;
 
-    if (!rom->init) {
-        Load2364 (rom);
-        rom->init = 1;
-    }
-
-    if (rom->CS == 0) {  // Read data when chip selected (active low)
+    if (rom->CS == 0 && rom->image) {  // Read data when chip selected (active low)
         for (i=0; i<13; i++) addr |= (rom->ADDR[i] << i);
-        data = rom->ROM[addr & 0x1fff];
+        data = rom->image[addr & 0x1fff];
     }
 
     for (i=0; i<8; i++) {
         rom->DATA[i] = (data >> i) & 1;
     }
 }
+
+void Step2364Word ( Context2364 * rom )
+{
+    if (rom->CS == 0 && rom->image) rom->D = rom->image[rom->A & 0x1fff];
+    else rom->D = 0;
+}
@@ -1,15 +1,27 @@
 // 8 KB ROM.
+// Contents are not copied: context only points to data mapped by board, one copy is shared by all instances.
+#pragma once
+
+#define ROM2364_SIZE    (8*1024)
 
 typedef struct Context2364
 {
-    unsigned char ROM[8*1024];
+    const unsigned char *image;     // mapped ROM data (NULL: not mapped, reads 0)
 
     int     CS;     // Active low
 
-    int     init;   // 0 when first run (load ROM)
-
     // Buses
     char    ADDR[13], DATA[8];
+
+    // Same buses as words, for Step2364Word.
+    unsigned short  A;
+    unsigned char   D;
 } Context2364;
 
-void Step2364 ( Context2364 * rom );
\ No newline at end of file
+void Step2364 ( Context2364 * rom );
+
+// Word-level access: A -> D, no bit unpacking.
+void Step2364Word ( Context2364 * rom );
+
+// Map ROM data (e.g. image mapped by ImageOpen). Data must be at least ROM2364_SIZE bytes and outlive context.
+int Map2364 ( Context2364 * rom, const unsigned char * data, unsigned long size );
@@ -1,4 +1,5 @@
 set PATH=c:\lcc\bin
 
-lc -nw -g2 6502.c -o 6502.exe
+lc -nw -g2 6502.c ROM2364.c -o 6502.exe
+lc -nw -g2 -DLOCKSTEP 6502.c LOCKSTEP.c ROM2364.c -o 6502ls.exe
 6502.exe > out.txt
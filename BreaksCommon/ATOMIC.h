@@ -0,0 +1,34 @@
+// Atomics and spin locks shared by chips and board.
+#pragma once
+
+// Atomics on aligned long/pointer-sized variables, xx64 on unsigned long long.
+#ifdef _WIN32
+#include <windows.h>
+#define ATOMIC_LOAD(p)          (*(volatile long *)(p))
+#define ATOMIC_STORE(p,v)       { MemoryBarrier (); *(volatile long *)(p) = (v); }
+#define ATOMIC_ADD(p,v)         InterlockedExchangeAdd ((volatile long *)(p), (v))
+#define ATOMIC_CAS(p,o,n)       (InterlockedCompareExchange ((volatile long *)(p), (n), (o)) == (o))
+#define ATOMIC_XCHG_PTR(p,v)    InterlockedExchangePointer ((void * volatile *)(p), (v))
+#define ATOMIC_LOAD64(p)        ((unsigned long long)InterlockedCompareExchange64 ((volatile LONGLONG *)(p), 0, 0))
+#define ATOMIC_STORE64(p,v)     InterlockedExchange64 ((volatile LONGLONG *)(p), (LONGLONG)(v))
+#define MEMORY_BARRIER()        MemoryBarrier ()
+#define CPU_PAUSE()             YieldProcessor ()
+#else
+#define ATOMIC_LOAD(p)          __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p,v)       __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_ADD(p,v)         __atomic_fetch_add ((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_CAS(p,o,n)       __sync_bool_compare_and_swap ((p), (o), (n))
+#define ATOMIC_XCHG_PTR(p,v)    __atomic_exchange_n ((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_LOAD64(p)        __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE64(p,v)     __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#define MEMORY_BARRIER()        __atomic_thread_fence (__ATOMIC_SEQ_CST)
+#if defined(__i386__) || defined(__x86_64__)
+#define CPU_PAUSE()             __builtin_ia32_pause ()
+#else
+#define CPU_PAUSE()             __atomic_signal_fence (__ATOMIC_SEQ_CST)
+#endif
+#endif
+
+// Spin lock on volatile long (0: free). For short one-time work such as building shared tables.
+#define SPIN_LOCK(p)            while ( !ATOMIC_CAS ((p), 0, 1) ) CPU_PAUSE ()
+#define SPIN_UNLOCK(p)          ATOMIC_STORE ((p), 0)
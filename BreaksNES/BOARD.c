@@ -0,0 +1,206 @@
+// NES board scheduler.
+#include <string.h>
+#include "BOARD.h"
+
+void NESInit (ContextNES *nes)
+{
+    int n;
+
+    memset (nes, 0, sizeof(ContextNES));
+
+    nes->divider[NES_CHIP_PPU] = NES_PPU_DIVIDER;
+    nes->divider[NES_CHIP_CPU] = NES_CPU_DIVIDER;
+
+    nes->apu.pad[APU_nIRQ] = 1;
+    nes->apu.pad[APU_nNMI] = 1;
+    nes->ppu.pad[PPU_nDBE] = 1;
+    nes->ppu.pad[PPU_nRD] = nes->ppu.pad[PPU_nWR] = 1;
+    nes->ppu.ctrl[PPU_CTRL_nINT] = 1;
+    nes->ppu.ctrl[PPU_CTRL_nTR] = nes->ppu.ctrl[PPU_CTRL_nTG] = nes->ppu.ctrl[PPU_CTRL_nTB] = 1;  // no emphasis
+    NESReset (nes, 1);
+    JoypadInit (&nes->pads, &nes->apu);
+
+    MemMapNES (&nes->mem, nes->ram, &nes->ppu, nes);
+    for (n=0; n<VMEM_PAGES; n++) nes->vmem.read[n] = nes->vmem.write[n] = nes->ciram;      // no cartridge
+}
+
+int NESLoad (ContextNES *nes, const char *path)
+{
+    if ( !CartLoad (&nes->cart, path) ) return 0;
+    CartConnect (&nes->cart, &nes->mem, &nes->vmem, nes->ciram);
+    return 1;
+}
+
+void NESReset (ContextNES *nes, int nRES)
+{
+    nes->apu.pad[APU_nRES] = nRES;
+    nes->ppu.pad[PPU_nRES] = nRES;
+}
+
+unsigned char NESReadIO (ContextNES *nes, unsigned short addr, unsigned char bus)
+{
+    return JoypadRead (&nes->pads, addr, bus);
+}
+
+// CPU cycle number of PHI2 edge.
+#define CPU_CYCLE(nes)  ((nes)->cycles[NES_CHIP_CPU] >> 1)
+
+static void StartDMA (ContextNES *nes, unsigned char page)
+{
+    SpriteDMA *dma = &nes->dma;
+    MemoryPage *mp = &nes->mem.page[page];
+    unsigned oam;
+
+    memset (dma, 0, sizeof(SpriteDMA));
+    dma->active = 1;
+    dma->halt = 1;
+    dma->src = page << 8;
+
+    // Fast path: host page is copied at once, bus is then held for the same number of cycles.
+    // Copy starts at OAM counter ($2003) and wraps, 256 $2004 writes leave the counter where it was.
+    // $2004 writes while rendering are not stored by PPU, fast path does not see that.
+    if ( !nes->dma_stepped && mp->read ) {
+        oam = (unsigned)nes->ppu.reg[PPU_REG_OAMCNT] & 0xff;
+        memcpy (nes->ppu.mem + PPU_MEM_OAM + oam, mp->read, 256 - oam);
+        memcpy (nes->ppu.mem + PPU_MEM_OAM, mp->read + 256 - oam, oam);
+        nes->mem.bus = mp->read[255];
+        nes->ppu.bus[PPU_BUS_DB] = mp->read[255];
+        dma->stall = 513 + (CPU_CYCLE(nes) & 1);
+    }
+}
+
+void NESWriteIO (ContextNES *nes, unsigned short addr, unsigned char data)
+{
+    if ( addr == 0x4014 ) StartDMA (nes, data);
+    else JoypadWrite (&nes->pads, addr, data);
+}
+
+static void DMACycle (ContextNES *nes)
+{
+    SpriteDMA *dma = &nes->dma;
+    int get = (CPU_CYCLE(nes) & 1) == 0;
+
+    if (dma->stall) {
+        if ( --dma->stall == 0 ) dma->active = 0;
+    }
+    else if (dma->halt) dma->halt--;
+    else if (get) {
+        dma->latch = MEM_READ (&nes->mem, dma->src);
+        dma->src++;
+        dma->have = 1;
+    }
+    else if (dma->have) {
+        MEM_WRITE (&nes->mem, 0x2004, dma->latch);
+        dma->have = 0;
+        if ( (dma->src & 0xff) == 0 ) dma->active = 0;
+    }
+}
+
+int NESBusNext (ContextNES *nes, unsigned short *addr)
+{
+    SpriteDMA *dma = &nes->dma;
+
+    if ( !dma->active ) {
+        *addr = (unsigned short)nes->apu.pad[APU_ADDR];
+        return nes->apu.pad[APU_RW] != 0;
+    }
+    if ( dma->stall || dma->halt ) return -1;
+    if ( (CPU_CYCLE(nes) & 1) == 0 ) {
+        *addr = dma->src;
+        return 1;
+    }
+    if ( !dma->have ) return -1;
+    *addr = 0x2004;
+    return 0;
+}
+
+// 2A03 edge. CPU bus cycle: address is set during PHI1, memory is accessed during PHI2.
+// 2A03 model has no RDY yet: while sprite DMA runs, board keeps core accesses off the bus.
+void NESEdgeCPU (ContextNES *nes)
+{
+    ContextAPU *apu = &nes->apu;
+    unsigned short addr = (unsigned short)apu->pad[APU_ADDR];
+    int phi2 = apu->ctrl[APU_CTRL_PHI0] & 1;
+    int halted = phi2 && nes->dma.active;
+
+    if (halted) DMACycle (nes);
+    else if (phi2 && apu->pad[APU_RW]) apu->pad[APU_DATA] = MEM_READ (&nes->mem, addr);
+
+    APUStep (apu);
+
+    if (phi2) {
+        if ( !halted && !apu->pad[APU_RW] ) MEM_WRITE (&nes->mem, addr, apu->pad[APU_DATA]);
+    }
+    else {                              // /DBE and /INx are only held during PHI2
+        MemRelease (&nes->mem);
+        JOYPAD_RELEASE (&nes->pads);
+    }
+
+    apu->ctrl[APU_CTRL_PHI0] ^= 1;
+}
+
+// PPU memory bus after PPU edge: address latch follows AD while ALE is high (MMC3 watches A12 there),
+// memory drives AD while /RD is low. Edge time is PPU's own (next PPU edge is not advanced yet): board
+// clock is only updated after NESStep, and PPU thread of NESRunCores does not update it at all.
+static void VideoBus (ContextNES *nes)
+{
+    if ( VMemBus (&nes->vmem, &nes->ppu) ) CartPPUAddr (&nes->cart, nes->vmem.addr, nes->next[NES_CHIP_PPU]);
+}
+
+// Step divider follows PPU mode: pixel steps once PPU is at pixel clock edge, CLK edges while it is not (/RES).
+void NESEdgePPU (ContextNES *nes)
+{
+    if ( nes->divider[NES_CHIP_PPU] == NES_PIXEL_DIVIDER ) {
+        if ( !PPUStepPixel (&nes->ppu) || nes->ppu_edges ) nes->divider[NES_CHIP_PPU] = NES_PPU_DIVIDER;
+    }
+    else {
+        PPUStep (&nes->ppu);
+        nes->ppu.pad[PPU_CLK] ^= 1;
+        if ( !nes->ppu_edges && PPUPixelAligned (&nes->ppu) ) nes->divider[NES_CHIP_PPU] = NES_PIXEL_DIVIDER;
+    }
+    VideoBus (nes);
+}
+
+int NESStep (ContextNES *nes)
+{
+    unsigned long long t = nes->next[0];
+    int n, mask = 0;
+
+    for (n=1; n<NES_CHIPS; n++) {
+        if ( nes->next[n] < t ) t = nes->next[n];
+    }
+    for (n=0; n<NES_CHIPS; n++) {
+        if ( nes->next[n] != t ) continue;
+        switch (n) {
+            case NES_CHIP_PPU:
+                NESEdgePPU (nes);
+                nes->apu.pad[APU_nNMI] = nes->ppu.ctrl[PPU_CTRL_nINT];     // PPU /INT is wired to 2A03 /NMI
+                nes->apu.pad[APU_nIRQ] = !nes->cart.state.irq;     // mapper IRQ changes on PPU bus (and on 2A03 writes, seen at next PPU edge)
+                break;
+            case NES_CHIP_CPU:
+                NESEdgeCPU (nes);
+                break;
+        }
+        nes->next[n] += nes->divider[n];
+        nes->cycles[n]++;
+        mask |= 1 << n;
+    }
+    nes->clk = t + 1;
+    return mask;
+}
+
+void NESRun (ContextNES *nes, unsigned long long until)
+{
+    unsigned long long t;
+    int n;
+
+    while (1) {
+        t = nes->next[0];
+        for (n=1; n<NES_CHIPS; n++) {
+            if ( nes->next[n] < t ) t = nes->next[n];
+        }
+        if ( t >= until ) break;
+        NESStep (nes);
+    }
+    nes->clk = until;
+}
@@ -0,0 +1,91 @@
+// NES board: one master clock drives 2A03 and PPU.
+//
+// Master clock tick is CLK half-cycle (CLK = 21.477 MHz, see BreaksAPU/clks.txt).
+// PPU is stepped on every CLK edge and derives pixel clock (CLK/4) itself, or, once at pixel clock edge,
+// by whole pixel clock halves (4 ticks): its outputs change only at pixel clock edges, so they are the same,
+// but pads driven by 2A03 are seen at next pixel clock edge.
+// 2A03 (6502 core + APU, one context) is stepped on every PHI0 edge, PHI0 = CLK/12, so every 12 ticks.
+// Chips are stepped only at their own edges; board keeps next edge time for each chip and jumps to nearest.
+#pragma once
+
+#include "../BreaksAPU/APU.h"
+#include "../BreaksPPU/PPU.h"
+#include "MEMMAP.h"
+#include "CART.h"
+#include "JOYPAD.h"
+
+#define NES_CPU_DIVIDER     12      // CLK half-cycles per PHI0 half-cycle
+#define NES_PPU_DIVIDER     1       // CLK half-cycles per PPU step
+#define NES_PIXEL_DIVIDER   4       // CLK half-cycles per PPU pixel step (PCLK half)
+
+#define NES_DOT             8       // CLK half-cycles per PPU dot (pixel clock CLK/4)
+#define NES_SCANLINE        (341 * NES_DOT)
+#define NES_FRAME           (262 * NES_SCANLINE)
+
+// Chips in order they are stepped within same master tick.
+// PPU goes first: it drives register data before CPU PHI2 read of same tick.
+enum {
+    NES_CHIP_PPU,
+    NES_CHIP_CPU,
+    NES_CHIPS,
+};
+
+// 2A03 sprite DMA ($4014): 256 bytes to $2004, CPU is halted meanwhile.
+// After halt cycle (and one more if next cycle is put cycle) bytes are read on get (even) CPU cycles and written on put cycles,
+// so it takes 513 or 514 cycles.
+typedef struct SpriteDMA
+{
+    int     active;
+    int     halt;                   // dummy cycles left before transfer
+    unsigned short  src;            // next source address
+    unsigned char   latch;          // byte read on get cycle
+    int     have;                   // latch waits for put cycle
+    unsigned long   stall;          // fast path: page is copied already, cycles left
+} SpriteDMA;
+
+typedef struct ContextNES
+{
+    unsigned long long  clk;                // master clock (CLK half-cycles), all edges before it are done
+    unsigned long long  next[NES_CHIPS];    // master clock time of next chip edge
+    unsigned long long  cycles[NES_CHIPS];  // chip steps executed (half-cycles; PPU: CLK edges or pixel clock halves)
+    unsigned long   divider[NES_CHIPS];
+
+    ContextAPU  apu;
+    ContextPPU  ppu;
+    unsigned char   ram[0x800];     // 2 KB internal RAM
+    unsigned char   ciram[0x800];   // 2 KB nametable RAM
+    Cartridge   cart;
+    Joypads     pads;               // controllers on $4016 / $4017
+    SpriteDMA   dma;
+    int     dma_stepped;            // 1: sprite DMA goes byte by byte over bus (accuracy testing), 0: one copy
+    int     ppu_edges;              // 1: PPU is stepped on every CLK edge (accuracy testing), 0: by pixel clock halves
+    MemoryMap   mem;                // CPU address space (pointers into this context)
+    VideoMap    vmem;               // PPU address space
+} ContextNES;
+
+// Clear board and chips, connect RAM and PPU. Cartridge is mapped later into mem.
+void NESInit (ContextNES *nes);
+
+// Insert cartridge image (iNES / NES 2.0). Returns 0 on error.
+int NESLoad (ContextNES *nes, const char *path);
+
+// Reset line (nRES = 0: hold in reset).
+void NESReset (ContextNES *nes, int nRES);
+
+// Execute all chip edges up to (not including) master clock time.
+void NESRun (ContextNES *nes, unsigned long long until);
+
+// Execute edges of nearest master tick. Returns mask of chips stepped (1 << NES_CHIP_xxx).
+int NESStep (ContextNES *nes);
+
+// 2A03 I/O space ($4000-$401F device page).
+unsigned char NESReadIO (ContextNES *nes, unsigned short addr, unsigned char bus);
+void NESWriteIO (ContextNES *nes, unsigned short addr, unsigned char data);
+
+// CPU bus access at next PHI2 (sprite DMA included), call when next CPU edge is PHI2.
+// Returns R/W of access and sets addr, -1 if bus is idle.
+int NESBusNext (ContextNES *nes, unsigned short *addr);
+
+// Single chip edge, without scheduling and wiring between chips (used by threaded runner).
+void NESEdgeCPU (ContextNES *nes);
+void NESEdgePPU (ContextNES *nes);
@@ -0,0 +1,316 @@
+// NES cartridge: iNES / NES 2.0 image and mapper.
+#include <string.h>
+#include "CART.h"
+
+#define PRG_BANK    0x2000      // CPU page table is filled in 8 KB units
+#define CHR_BANK    0x400       // PPU page table is filled in 1 KB units
+
+#define A12_FILTER  (3 * 24)    // MMC3 ignores A12 rise if it was low for less than ~3 M2 cycles (master ticks)
+
+// ------------------------------------------------------------------------
+// Header
+
+int CartLoad (Cartridge *cart, const char *path)
+{
+    const unsigned char *hdr;
+    unsigned long prg, chr, offset = 16;
+
+    memset (cart, 0, sizeof(Cartridge));
+    if ( !ImageOpen (&cart->image, path) ) return 0;
+    hdr = cart->image.data;
+
+    if ( cart->image.size < 16 || memcmp (hdr, "NES\x1a", 4) ) {
+        CartUnload (cart);
+        return 0;
+    }
+
+    prg = hdr[4];
+    chr = hdr[5];
+    cart->mapper = (hdr[6] >> 4) | (hdr[7] & 0xf0);
+    cart->nes20 = (hdr[7] & 0x0c) == 0x08;
+    if (cart->nes20) {
+        cart->mapper |= (hdr[8] & 0x0f) << 8;
+        cart->submapper = hdr[8] >> 4;
+        if ( (hdr[9] & 0x0f) == 0x0f || (hdr[9] >> 4) == 0x0f ) {   // exponent-multiplier sizes are not used by supported boards
+            CartUnload (cart);
+            return 0;
+        }
+        prg |= (hdr[9] & 0x0f) << 8;
+        chr |= (hdr[9] >> 4) << 8;
+    }
+    else if ( hdr[7] & 0x0c ) cart->mapper &= 0x0f;     // junk in bytes 7-15 (old dumpers)
+
+    cart->battery = (hdr[6] >> 1) & 1;
+    if ( hdr[6] & 8 ) cart->state.mirroring = CART_MIRROR_FOUR;
+    else cart->state.mirroring = (hdr[6] & 1) ? CART_MIRROR_VERTICAL : CART_MIRROR_HORIZONTAL;
+    if ( hdr[6] & 4 ) offset += 512;        // trainer
+
+    cart->prg_size = prg * 0x4000;
+    cart->chr_size = chr * 0x2000;
+    if ( cart->prg_size == 0 || offset + cart->prg_size + cart->chr_size > cart->image.size ) {
+        CartUnload (cart);
+        return 0;
+    }
+    cart->prg = hdr + offset;
+    cart->chr = cart->chr_size ? hdr + offset + cart->prg_size : NULL;
+
+    switch (cart->mapper) {
+        case CART_NROM: case CART_MMC1: case CART_UXROM: case CART_CNROM: case CART_MMC3:
+            break;
+        default:
+            CartUnload (cart);
+            return 0;
+    }
+
+    // Power-up mapper state.
+    if ( cart->mapper == CART_MMC1 ) cart->state.ctrl = 0x0c;      // PRG mode 3: last bank fixed at $C000
+    return 1;
+}
+
+void CartUnload (Cartridge *cart)
+{
+    ImageClose (&cart->image);
+    cart->prg = cart->chr = NULL;
+}
+
+// ------------------------------------------------------------------------
+// Page tables
+
+// Map 8 KB PRG bank to $8000 + 8 KB * slot. Negative bank counts from the end.
+static void MapPRG (Cartridge *cart, int slot, int bank)
+{
+    int banks = cart->prg_size / PRG_BANK;
+    int page = 0x80 + slot * (PRG_BANK / MEM_PAGE_SIZE);
+
+    if (bank < 0) bank += banks;
+    bank %= banks;
+    // ROM is never written through page table: writes go to MEM_DEVICE_CART.
+    MemMapHost (cart->mem, page, page + PRG_BANK / MEM_PAGE_SIZE - 1, (unsigned char *)cart->prg + bank * PRG_BANK, PRG_BANK, 0);
+}
+
+// Map 1 KB CHR bank to $0000 + 1 KB * slot.
+static void MapCHR (Cartridge *cart, int slot, int bank)
+{
+    if (cart->chr) {
+        bank %= cart->chr_size / CHR_BANK;
+        cart->vmem->read[slot] = (unsigned char *)cart->chr + bank * CHR_BANK;
+        cart->vmem->write[slot] = NULL;
+    }
+    else {
+        bank %= sizeof(cart->state.chr_ram) / CHR_BANK;
+        cart->vmem->read[slot] = cart->vmem->write[slot] = cart->state.chr_ram + bank * CHR_BANK;
+    }
+}
+
+static void MapNametables (Cartridge *cart)
+{
+    unsigned char *nt[4];
+    unsigned char *a = cart->ciram, *b = cart->ciram + 0x400;
+    int n;
+
+    switch (cart->state.mirroring) {
+        case CART_MIRROR_HORIZONTAL: nt[0] = a; nt[1] = a; nt[2] = b; nt[3] = b; break;
+        case CART_MIRROR_VERTICAL: nt[0] = a; nt[1] = b; nt[2] = a; nt[3] = b; break;
+        case CART_MIRROR_SINGLE0: nt[0] = nt[1] = nt[2] = nt[3] = a; break;
+        case CART_MIRROR_SINGLE1: nt[0] = nt[1] = nt[2] = nt[3] = b; break;
+        default:
+            nt[0] = a; nt[1] = b;
+            nt[2] = cart->state.vram; nt[3] = cart->state.vram + 0x400;
+            break;
+    }
+
+    for (n=0; n<8; n++) {       // $2000-$3FFF, $3000-$3EFF mirrors $2000-$2EFF
+        cart->vmem->read[8 + n] = cart->vmem->write[8 + n] = nt[n & 3];
+    }
+}
+
+static void RemapMMC1 (Cartridge *cart)
+{
+    CartridgeState *s = &cart->state;
+    int outer = 0, prg = s->reg[3] & 0x0f;
+    int n, last;
+
+    static int mirror[4] = { CART_MIRROR_SINGLE0, CART_MIRROR_SINGLE1, CART_MIRROR_VERTICAL, CART_MIRROR_HORIZONTAL };
+    s->mirroring = mirror[s->ctrl & 3];
+
+    if ( cart->prg_size > 0x40000 ) outer = (s->reg[1] & 0x10) * 2;      // SUROM: CHR0 bit 4 selects 256 KB half (in 8 KB banks)
+
+    switch ( (s->ctrl >> 2) & 3 ) {
+        case 0: case 1:         // 32 KB
+            for (n=0; n<4; n++) MapPRG (cart, n, outer + (prg & 0x0e) * 2 + n);
+            break;
+        case 2:                 // first bank fixed at $8000
+            MapPRG (cart, 0, outer); MapPRG (cart, 1, outer + 1);
+            MapPRG (cart, 2, outer + prg * 2); MapPRG (cart, 3, outer + prg * 2 + 1);
+            break;
+        case 3:                 // last bank fixed at $C000
+            MapPRG (cart, 0, outer + prg * 2); MapPRG (cart, 1, outer + prg * 2 + 1);
+            last = cart->prg_size > 0x40000 ? outer + 30 : -2;
+            MapPRG (cart, 2, last); MapPRG (cart, 3, last + 1);
+            break;
+    }
+
+    if ( s->ctrl & 0x10 ) {     // two 4 KB banks
+        for (n=0; n<4; n++) {
+            MapCHR (cart, n, s->reg[1] * 4 + n);
+            MapCHR (cart, 4 + n, s->reg[2] * 4 + n);
+        }
+    }
+    else {
+        for (n=0; n<8; n++) MapCHR (cart, n, (s->reg[1] & 0x1e) * 4 + n);
+    }
+}
+
+static void RemapMMC3 (Cartridge *cart)
+{
+    CartridgeState *s = &cart->state;
+    int inv = (s->ctrl & 0x80) ? 4 : 0;     // CHR A12 inversion
+    int n;
+
+    if ( s->ctrl & 0x40 ) {
+        MapPRG (cart, 0, -2); MapPRG (cart, 2, s->reg[6]);
+    }
+    else {
+        MapPRG (cart, 0, s->reg[6]); MapPRG (cart, 2, -2);
+    }
+    MapPRG (cart, 1, s->reg[7]);
+    MapPRG (cart, 3, -1);
+
+    for (n=0; n<2; n++) {       // R0/R1: 2 KB banks
+        MapCHR (cart, (inv ^ 0) + n, (s->reg[0] & 0xfe) + n);
+        MapCHR (cart, (inv ^ 2) + n, (s->reg[1] & 0xfe) + n);
+    }
+    for (n=0; n<4; n++) MapCHR (cart, (inv ^ 4) + n, s->reg[2 + n]);    // R2-R5: 1 KB banks
+}
+
+void CartRemap (Cartridge *cart)
+{
+    CartridgeState *s = &cart->state;
+    int n;
+
+    if ( cart->mem == NULL ) return;
+
+    switch (cart->mapper) {
+        case CART_NROM:
+            for (n=0; n<4; n++) MapPRG (cart, n, n);
+            for (n=0; n<8; n++) MapCHR (cart, n, n);
+            break;
+        case CART_MMC1:
+            RemapMMC1 (cart);
+            break;
+        case CART_UXROM:
+            MapPRG (cart, 0, s->reg[0] * 2); MapPRG (cart, 1, s->reg[0] * 2 + 1);
+            MapPRG (cart, 2, -2); MapPRG (cart, 3, -1);
+            for (n=0; n<8; n++) MapCHR (cart, n, n);
+            break;
+        case CART_CNROM:
+            for (n=0; n<4; n++) MapPRG (cart, n, n);
+            for (n=0; n<8; n++) MapCHR (cart, n, s->reg[0] * 8 + n);
+            break;
+        case CART_MMC3:
+            RemapMMC3 (cart);
+            break;
+    }
+
+    MapNametables (cart);
+}
+
+void CartConnect (Cartridge *cart, MemoryMap *mem, VideoMap *vmem, unsigned char *ciram)
+{
+    cart->mem = mem;
+    cart->vmem = vmem;
+    cart->ciram = ciram;
+
+    MemMapHost (mem, 0x60, 0x7f, cart->state.prg_ram, sizeof(cart->state.prg_ram), 1);
+    MemMapDevice (mem, 0x80, 0xff, MEM_DEVICE_CART, cart);
+    CartRemap (cart);
+}
+
+// ------------------------------------------------------------------------
+// Registers
+
+static void WriteMMC1 (Cartridge *cart, unsigned short addr, unsigned char data)
+{
+    CartridgeState *s = &cart->state;
+
+    if ( data & 0x80 ) {        // reset serial port
+        s->shift = s->count = 0;
+        s->ctrl |= 0x0c;
+        RemapMMC1 (cart);
+        MapNametables (cart);
+        return;
+    }
+
+    s->shift |= (data & 1) << s->count;
+    if ( ++s->count < 5 ) return;
+
+    switch ( (addr >> 13) & 3 ) {
+        case 0: s->ctrl = s->shift; break;
+        case 1: s->reg[1] = s->shift; break;
+        case 2: s->reg[2] = s->shift; break;
+        case 3: s->reg[3] = s->shift; break;
+    }
+    s->shift = s->count = 0;
+    RemapMMC1 (cart);
+    MapNametables (cart);
+}
+
+static void WriteMMC3 (Cartridge *cart, unsigned short addr, unsigned char data)
+{
+    CartridgeState *s = &cart->state;
+
+    switch ( addr & 0xe001 ) {
+        case 0x8000: s->ctrl = data; break;
+        case 0x8001: s->reg[s->ctrl & 7] = data; break;
+        case 0xa000:
+            if ( s->mirroring != CART_MIRROR_FOUR ) {
+                s->mirroring = (data & 1) ? CART_MIRROR_HORIZONTAL : CART_MIRROR_VERTICAL;
+                MapNametables (cart);
+            }
+            return;
+        case 0xa001: return;        // PRG RAM protect is not emulated
+        case 0xc000: s->irq_latch = data; return;
+        case 0xc001: s->irq_counter = 0; s->irq_reload = 1; return;
+        case 0xe000: s->irq_enable = 0; s->irq = 0; return;
+        case 0xe001: s->irq_enable = 1; return;
+    }
+    RemapMMC3 (cart);
+}
+
+void CartWrite (Cartridge *cart, unsigned short addr, unsigned char data)
+{
+    switch (cart->mapper) {
+        case CART_MMC1:
+            WriteMMC1 (cart, addr, data);
+            break;
+        case CART_UXROM:
+        case CART_CNROM:
+            cart->state.reg[0] = data;
+            CartRemap (cart);
+            break;
+        case CART_MMC3:
+            WriteMMC3 (cart, addr, data);
+            break;
+    }
+}
+
+void CartPPUAddr (Cartridge *cart, unsigned short addr, unsigned long long clk)
+{
+    CartridgeState *s = &cart->state;
+    int a12 = (addr >> 12) & 1;
+
+    if ( cart->mapper != CART_MMC3 || a12 == s->a12 ) return;
+    s->a12 = a12;
+    if ( !a12 ) {
+        s->a12_low = clk;
+        return;
+    }
+    if ( clk - s->a12_low < A12_FILTER ) return;
+
+    if ( s->irq_counter == 0 || s->irq_reload ) {
+        s->irq_counter = s->irq_latch;
+        s->irq_reload = 0;
+    }
+    else s->irq_counter--;
+    if ( s->irq_counter == 0 && s->irq_enable ) s->irq = 1;
+}
@@ -0,0 +1,75 @@
+// NES cartridge: iNES / NES 2.0 image and mapper.
+// PRG and CHR ROM are used directly from mapped image file. Bank switching only swaps page pointers
+// in CPU (MemoryMap) and PPU (VideoMap) address spaces, so nothing is copied and load time does not
+// depend on ROM size.
+#pragma once
+
+#include "IMAGE.h"
+#include "MEMMAP.h"
+
+// Supported mappers (iNES numbers).
+enum {
+    CART_NROM = 0,
+    CART_MMC1 = 1,
+    CART_UXROM = 2,
+    CART_CNROM = 3,
+    CART_MMC3 = 4,
+};
+
+// Nametable mirroring.
+enum {
+    CART_MIRROR_HORIZONTAL,
+    CART_MIRROR_VERTICAL,
+    CART_MIRROR_SINGLE0,
+    CART_MIRROR_SINGLE1,
+    CART_MIRROR_FOUR,
+};
+
+// Mapper state. Plain data, page pointers are derived from it by CartRemap.
+typedef struct CartridgeState
+{
+    int     mirroring;
+    unsigned char   reg[8];         // mapper registers (MMC3: R0-R7)
+    unsigned char   ctrl;           // MMC1 control / MMC3 bank select
+    unsigned char   shift, count;   // MMC1 serial port
+    unsigned char   irq_latch, irq_counter;     // MMC3 scanline counter
+    char    irq_reload, irq_enable, irq;
+    char    a12;                    // last PPU A12 level seen by MMC3
+    unsigned long long  a12_low;    // master clock time when A12 went low
+    unsigned char   prg_ram[0x2000];    // $6000-$7FFF
+    unsigned char   chr_ram[0x2000];    // when there is no CHR ROM
+    unsigned char   vram[0x800];        // extra nametables for four-screen mirroring
+} CartridgeState;
+
+typedef struct Cartridge
+{
+    Image   image;
+    const unsigned char *prg, *chr;     // ROM inside image (chr NULL: CHR RAM)
+    unsigned long   prg_size, chr_size;
+    int     mapper, submapper;
+    int     battery;
+    int     nes20;                      // NES 2.0 header
+
+    CartridgeState  state;
+
+    // Connected address spaces.
+    MemoryMap   *mem;
+    VideoMap    *vmem;
+    unsigned char   *ciram;             // 2 KB console nametable RAM
+} Cartridge;
+
+// Map image and parse header. Returns 0 on error or unsupported mapper.
+int CartLoad (Cartridge *cart, const char *path);
+void CartUnload (Cartridge *cart);
+
+// Plug cartridge into CPU and PPU address spaces.
+void CartConnect (Cartridge *cart, MemoryMap *mem, VideoMap *vmem, unsigned char *ciram);
+
+// Set all page pointers from mapper state (after connect or state load).
+void CartRemap (Cartridge *cart);
+
+// CPU write to $8000-$FFFF.
+void CartWrite (Cartridge *cart, unsigned short addr, unsigned char data);
+
+// PPU address bus change (MMC3 counts A12 rising edges). clk is master clock time.
+void CartPPUAddr (Cartridge *cart, unsigned short addr, unsigned long long clk);
@@ -0,0 +1,20 @@
+// CD4021 shift register simulator.
+#include "CD4021.h"
+
+void Step4021 ( Context4021 * sr )
+{
+    int i;
+
+    if (sr->PS) {
+        for (i=0; i<8; i++) sr->Q[i] = sr->P[i];
+    }
+    else if ( sr->CLK && !sr->CLK_old ) {
+        for (i=7; i>0; i--) sr->Q[i] = sr->Q[i-1];
+        sr->Q[0] = sr->SER;
+    }
+    sr->CLK_old = sr->CLK;
+
+    sr->Q6 = sr->Q[5];
+    sr->Q7 = sr->Q[6];
+    sr->Q8 = sr->Q[7];
+}
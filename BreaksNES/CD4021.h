@@ -0,0 +1,24 @@
+// CD4021 8-stage static shift register (parallel in / serial out), as used in NES controller.
+// See Docs/NES/NESController/CD4021.pdf.
+//
+// P/S = 1: stages are loaded from P1-P8 asynchronously (as long as P/S is high).
+// P/S = 0: rising CLK edge shifts Q1 <- SER, Qn <- Qn-1.
+#pragma once
+
+typedef struct Context4021
+{
+    // Inputs
+    char    P[8];       // P1-P8
+    char    PS;         // parallel / serial
+    char    CLK;
+    char    SER;
+
+    // Outputs
+    char    Q6, Q7, Q8;
+
+    // Internal
+    char    Q[8];       // stages Q1-Q8
+    char    CLK_old;    // CLK level seen by previous step
+} Context4021;
+
+void Step4021 ( Context4021 * sr );
@@ -0,0 +1,161 @@
+// NES board with each chip on its own pinned core.
+#include <stdlib.h>
+#include "THREAD.h"
+#include "CORES.h"
+
+#define NEVER       (~0ULL)
+#define LINE_MASK   (CORES_LINES - 1)
+
+// Spin, then give up time slice: chips may share one core.
+static void Wait (CoresNES *cores, int chip, int *spins)
+{
+    cores->waits[chip]++;
+    if ( ++*spins < CORES_SPIN ) CPU_PAUSE ();
+    else {
+        *spins = 0;
+        ThreadYield ();
+    }
+}
+
+// Both threads must exist before any edge is made.
+static int Start (CoresNES *cores, int chip)
+{
+    int spins = 0;
+    long go;
+
+    while ( (go = ATOMIC_LOAD(&cores->go)) == 0 ) Wait (cores, chip, &spins);
+    if ( go < 0 ) return 0;
+
+    if ( cores->core >= 0 ) ThreadPin (cores->core + (chip == NES_CHIP_CPU));
+    return 1;
+}
+
+// Last master tick PPU may run before 2A03 can change PPU pads.
+// Pads change only on PHI2 access to device page (PPU registers, mapper) and on /DBE release at next PHI1.
+static unsigned long long Horizon (ContextNES *nes)
+{
+    ContextAPU *apu = &nes->apu;
+    unsigned long long next = nes->next[NES_CHIP_CPU];
+    MemoryPage *page;
+    unsigned short addr;
+    int rw;
+
+    if ( apu->ctrl[APU_CTRL_PHI0] & 1 ) {      // PHI2, address is known
+        rw = NESBusNext (nes, &addr);
+        page = &nes->mem.page[MEM_PAGE(addr)];
+        if ( rw >= 0 && (rw ? page->read == NULL : page->write == NULL) ) return next;
+        return next + 2 * NES_CPU_DIVIDER;      // next PHI2 after it
+    }
+    if ( nes->mem.dbe ) return next;
+    return next + NES_CPU_DIVIDER;
+}
+
+// Pass 2A03 input line change at PPU edge t. Returns new ring head.
+static long Line (CoresNES *cores, long head, unsigned long long t, int pad, int level, int *spins)
+{
+    while ( head - ATOMIC_LOAD(&cores->line_tail) >= CORES_LINES ) Wait (cores, NES_CHIP_PPU, spins);
+    cores->line[head & LINE_MASK].t = t;
+    cores->line[head & LINE_MASK].pad = pad;
+    cores->line[head & LINE_MASK].level = level;
+    ATOMIC_STORE (&cores->line_head, ++head);
+    return head;
+}
+
+static void PPUThread (void *arg)
+{
+    CoresNES *cores = (CoresNES *)arg;
+    ContextNES *nes = cores->nes;
+    unsigned long long t;
+    long head = 0;
+    int spins = 0, nint = nes->ppu.ctrl[PPU_CTRL_nINT], nirq = !nes->cart.state.irq;
+
+    if ( !Start (cores, NES_CHIP_PPU) ) return;
+
+    while ( (t = nes->next[NES_CHIP_PPU]) < cores->until ) {
+        if ( t > ATOMIC_LOAD64(&cores->horizon) ) {
+            Wait (cores, NES_CHIP_PPU, &spins);
+            continue;
+        }
+
+        NESEdgePPU (nes);
+        nes->next[NES_CHIP_PPU] += nes->divider[NES_CHIP_PPU];
+        nes->cycles[NES_CHIP_PPU]++;
+
+        if ( nes->ppu.ctrl[PPU_CTRL_nINT] != nint ) {
+            nint = nes->ppu.ctrl[PPU_CTRL_nINT];
+            head = Line (cores, head, t, APU_nNMI, nint, &spins);
+        }
+        if ( (!nes->cart.state.irq) != nirq ) {
+            nirq = !nes->cart.state.irq;
+            head = Line (cores, head, t, APU_nIRQ, nirq, &spins);
+        }
+
+        ATOMIC_STORE64 (&cores->ppu_next, nes->next[NES_CHIP_PPU]);
+    }
+}
+
+static void CPUThread (void *arg)
+{
+    CoresNES *cores = (CoresNES *)arg;
+    ContextNES *nes = cores->nes;
+    unsigned long long c, need;
+    long tail = 0;
+    int spins = 0;
+
+    if ( !Start (cores, NES_CHIP_CPU) ) return;
+
+    while ( (c = nes->next[NES_CHIP_CPU]) < cores->until ) {
+        // PPU edge of same tick goes first. Pad changes need it exactly, otherwise quantum is allowed.
+        need = c + 1;
+        if ( cores->horizon != c ) need = need > cores->quantum ? need - cores->quantum : 0;
+        if ( ATOMIC_LOAD64(&cores->ppu_next) < need ) {
+            Wait (cores, NES_CHIP_CPU, &spins);
+            continue;
+        }
+
+        while ( tail != ATOMIC_LOAD(&cores->line_head) && cores->line[tail & LINE_MASK].t <= c ) {
+            nes->apu.pad[cores->line[tail & LINE_MASK].pad] = cores->line[tail & LINE_MASK].level;
+            ATOMIC_STORE (&cores->line_tail, ++tail);
+        }
+
+        NESEdgeCPU (nes);
+        nes->next[NES_CHIP_CPU] += nes->divider[NES_CHIP_CPU];
+        nes->cycles[NES_CHIP_CPU]++;
+
+        ATOMIC_STORE64 (&cores->horizon, Horizon (nes));
+    }
+
+    ATOMIC_STORE64 (&cores->horizon, NEVER);
+}
+
+void NESRunCores (CoresNES *cores, ContextNES *nes, unsigned long long until)
+{
+    Thread ppu, cpu;
+    int n;
+
+    cores->nes = nes;
+    cores->until = until;
+    cores->ppu_next = nes->next[NES_CHIP_PPU];
+    cores->horizon = Horizon (nes);
+    cores->line_head = cores->line_tail = 0;
+    cores->go = 0;
+    for (n=0; n<NES_CHIPS; n++) cores->waits[n] = 0;
+    if ( cores->core >= 0 && cores->core + 1 >= ThreadCores () ) cores->core = -1;
+
+    ppu = ThreadCreate (PPUThread, cores);
+    cpu = ThreadCreate (CPUThread, cores);
+    if ( ppu == NULL || cpu == NULL ) {     // fall back to single thread
+        ATOMIC_STORE (&cores->go, -1);
+        ThreadJoin (ppu);
+        ThreadJoin (cpu);
+        NESRun (nes, until);
+        return;
+    }
+    ATOMIC_STORE (&cores->go, 1);
+    ThreadJoin (ppu);
+    ThreadJoin (cpu);
+
+    nes->apu.pad[APU_nNMI] = nes->ppu.ctrl[PPU_CTRL_nINT];
+    nes->apu.pad[APU_nIRQ] = !nes->cart.state.irq;
+    nes->clk = until;
+}
@@ -0,0 +1,49 @@
+// NES board with each chip on its own pinned core.
+//
+// 2A03 and PPU threads publish their next edge time in atomic counters and spin-wait on each other:
+// - PPU runs ahead of 2A03 up to CPU horizon: next CPU edge that can change PPU pads
+//   (PHI2 access to device page, /DBE release). Between such edges PPU is free to run.
+// - 2A03 steps edge only after PPU did all edges of same master tick (PPU goes first, as in NESStep).
+//   With quantum > 0 it may run up to quantum ticks ahead of PPU, except for device accesses;
+//   then /NMI edges are seen late by up to quantum ticks.
+// - PPU /INT and mapper IRQ changes are passed to 2A03 with their timestamps, so 2A03 never sees future
+//   /NMI or /IRQ level. Mapper IRQ is only read by PPU thread: it changes on PPU bus, and 2A03 writes to
+//   mapper stop PPU at horizon, so they are seen at next PPU edge, as in NESStep.
+// 6502 core and APU share one 2A03 context (and APUStep), so they are one thread here.
+// Result is bit-exact with NESRun when quantum = 0.
+#pragma once
+
+#include "BOARD.h"
+
+#define CORES_LINES     256         // /NMI, /IRQ changes in flight (power of 2)
+#define CORES_SPIN      1024        // spins before giving up time slice
+
+typedef struct CoresNES
+{
+    // Set by caller.
+    unsigned long   quantum;        // 2A03 run-ahead over PPU (ticks), 0: exact
+    int     core;                   // first core to pin on (PPU, then 2A03), -1: no pinning
+
+    ContextNES  *nes;
+    unsigned long long  until;
+    volatile long   go;             // 1: both threads started, -1: cancelled
+
+    // Published by PPU thread.
+    volatile unsigned long long ppu_next;
+    struct {
+        unsigned long long  t;
+        int     pad;                // APU_nNMI, APU_nIRQ
+        int     level;
+    } line[CORES_LINES];
+    volatile long   line_head;
+
+    // Published by 2A03 thread.
+    volatile unsigned long long horizon;
+    volatile long   line_tail;
+
+    // Statistics.
+    unsigned long long  waits[NES_CHIPS];
+} CoresNES;
+
+// Same as NESRun, on two pinned threads.
+void NESRunCores (CoresNES *cores, ContextNES *nes, unsigned long long until);
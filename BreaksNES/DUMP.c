@@ -0,0 +1,382 @@
+// Frame dumper.
+#include <stdlib.h>
+#include <string.h>
+#include "NTSC.h"
+#include "DUMP.h"
+
+#define PIX_SIZE    (PPU_HEIGHT * PPU_WIDTH * 2)
+#define PNG_ROW     (1 + PPU_WIDTH * 3)         // filter byte + RGB
+#define PNG_RAW     (PPU_HEIGHT * PNG_ROW)
+#define OUT_SIZE    (PNG_RAW * 9 / 8 + 256)     // fixed Huffman: 9 bits per literal at most
+
+// ------------------------------------------------------------------------
+// Deflate (fixed Huffman codes, greedy LZ77) and PNG
+
+static const unsigned short len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static unsigned short lit_code[288];        // bit-reversed (deflate sends Huffman codes MSB first)
+static unsigned char lit_len[288];
+static unsigned char dist_code[30];
+static unsigned long crc_table[256];
+static volatile long tables_ready;
+
+typedef struct Bits
+{
+    unsigned char   *p;
+    unsigned long   acc;
+    int     n;
+} Bits;
+
+static unsigned Reverse (unsigned code, int len)
+{
+    unsigned r = 0;
+
+    while (len--) {
+        r = (r << 1) | (code & 1);
+        code >>= 1;
+    }
+    return r;
+}
+
+static void Tables (void)
+{
+    unsigned long c;
+    int n, k;
+
+    if ( ATOMIC_LOAD (&tables_ready) ) return;
+    for (n=0; n<288; n++) {
+        if ( n < 144 ) { c = 0x30 + n; lit_len[n] = 8; }
+        else if ( n < 256 ) { c = 0x190 + n - 144; lit_len[n] = 9; }
+        else if ( n < 280 ) { c = n - 256; lit_len[n] = 7; }
+        else { c = 0xc0 + n - 280; lit_len[n] = 8; }
+        lit_code[n] = (unsigned short)Reverse (c, lit_len[n]);
+    }
+    for (n=0; n<30; n++) dist_code[n] = (unsigned char)Reverse (n, 5);
+    for (n=0; n<256; n++) {
+        c = n;
+        for (k=0; k<8; k++) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+    ATOMIC_STORE (&tables_ready, 1);
+}
+
+static void Put (Bits *b, unsigned long v, int n)
+{
+    b->acc |= v << b->n;
+    b->n += n;
+    while ( b->n >= 8 ) {
+        *b->p++ = (unsigned char)b->acc;
+        b->acc >>= 8;
+        b->n -= 8;
+    }
+}
+
+static void Match (Bits *b, unsigned long len, unsigned long dist)
+{
+    int k;
+
+    for (k=28; len_base[k] > len; k--) ;
+    Put (b, lit_code[257 + k], lit_len[257 + k]);
+    Put (b, len - len_base[k], len_extra[k]);
+    for (k=29; dist_base[k] > dist; k--) ;
+    Put (b, dist_code[k], 5);
+    Put (b, dist - dist_base[k], dist_extra[k]);
+}
+
+#define HASH(p)     ((((p)[0] << 10) ^ ((p)[1] << 5) ^ (p)[2]) & (DUMP_HASH - 1))
+
+// One final block. Returns size of output.
+static unsigned long Deflate (const unsigned char *in, unsigned long size, unsigned char *out, int *hash)
+{
+    Bits b;
+    unsigned long i = 0, len, j;
+    long cand;
+
+    b.p = out;
+    b.acc = 0;
+    b.n = 0;
+    for (j=0; j<DUMP_HASH; j++) hash[j] = -1;
+
+    Put (&b, 1, 1);             // BFINAL
+    Put (&b, 1, 2);             // fixed Huffman
+    while ( i < size ) {
+        len = 0;
+        if ( i + 3 <= size ) {
+            cand = hash[HASH(in + i)];
+            hash[HASH(in + i)] = (int)i;
+            if ( cand >= 0 && i - cand <= 32768 ) {
+                while ( len < 258 && i + len < size && in[cand + len] == in[i + len] ) len++;
+            }
+        }
+        if ( len >= 3 ) {
+            Match (&b, len, i - cand);
+            for (j=1; j<len && i + j + 3 <= size; j++) hash[HASH(in + i + j)] = (int)(i + j);
+            i += len;
+        }
+        else {
+            Put (&b, lit_code[in[i]], lit_len[in[i]]);
+            i++;
+        }
+    }
+    Put (&b, lit_code[256], lit_len[256]);
+    if ( b.n ) *b.p++ = (unsigned char)b.acc;
+    return (unsigned long)(b.p - out);
+}
+
+static void BE32 (unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Chunk data is already at p + 8. Returns chunk size.
+static unsigned long Chunk (unsigned char *p, const char *type, unsigned long size)
+{
+    unsigned long crc = 0xffffffff, n;
+
+    BE32 (p, size);
+    memcpy (p + 4, type, 4);
+    for (n=0; n<size+4; n++) crc = crc_table[(crc ^ p[4 + n]) & 0xff] ^ (crc >> 8);
+    BE32 (p + 8 + size, crc ^ 0xffffffff);
+    return size + 12;
+}
+
+static unsigned long Png (Dump *d, DumpSlot *s)
+{
+    static const unsigned char sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    unsigned char *p = s->out, *row, *rgb;
+    unsigned long a = 1, b = 0, size, n;
+    int x, y;
+
+    for (y=0; y<PPU_HEIGHT; y++) {
+        row = s->raw + y * PNG_ROW;
+        *row++ = 0;             // filter: none
+        for (x=0; x<PPU_WIDTH; x++) {
+            rgb = d->rgb[s->pix[y * PPU_WIDTH + x] & 511];
+            *row++ = rgb[0];
+            *row++ = rgb[1];
+            *row++ = rgb[2];
+        }
+    }
+
+    memcpy (p, sig, 8);
+    p += 8;
+    BE32 (p + 8, PPU_WIDTH);
+    BE32 (p + 12, PPU_HEIGHT);
+    p[16] = 8;                  // bit depth
+    p[17] = 2;                  // RGB
+    p[18] = p[19] = p[20] = 0;  // deflate, adaptive filters, no interlace
+    p += Chunk (p, "IHDR", 13);
+
+    p[8] = 0x78;                // zlib: deflate, 32K window
+    p[9] = 0x01;
+    size = Deflate (s->raw, PNG_RAW, p + 10, s->hash);
+    for (n=0; n<PNG_RAW; n++) {
+        a = (a + s->raw[n]) % 65521;
+        b = (b + a) % 65521;
+    }
+    BE32 (p + 10 + size, (b << 16) | a);
+    p += Chunk (p, "IDAT", size + 6);
+    p += Chunk (p, "IEND", 0);
+    return (unsigned long)(p - s->out);
+}
+
+// ------------------------------------------------------------------------
+// Raw and Y4M
+
+static unsigned long Raw (DumpSlot *s)
+{
+    unsigned long n;
+
+    for (n=0; n<PPU_HEIGHT*PPU_WIDTH; n++) {
+        s->out[2 * n] = (unsigned char)s->pix[n];
+        s->out[2 * n + 1] = (unsigned char)(s->pix[n] >> 8);
+    }
+    return PIX_SIZE;
+}
+
+static unsigned long Y4m (Dump *d, DumpSlot *s)
+{
+    unsigned char *p;
+    unsigned long n;
+    int c;
+
+    memcpy (s->out, "FRAME\n", 6);
+    p = s->out + 6;
+    for (c=0; c<3; c++) {
+        for (n=0; n<PPU_HEIGHT*PPU_WIDTH; n++) *p++ = d->yuv[s->pix[n] & 511][c];
+    }
+    return (unsigned long)(p - s->out);
+}
+
+// ------------------------------------------------------------------------
+// Queue
+
+static void Encode (Dump *d, long t)
+{
+    DumpSlot *s = &d->slot[t % DUMP_QUEUE];
+    char name[300];
+    unsigned long size;
+    FILE *f;
+
+    if ( d->format == DUMP_PNG ) {
+        size = Png (d, s);
+        sprintf (name, d->path, s->n);
+        f = fopen (name, "wb");
+        if ( f == NULL || fwrite (s->out, 1, size, f) != size ) ATOMIC_ADD (&d->errors, 1);
+        if (f) fclose (f);
+    }
+    else {
+        size = d->format == DUMP_Y4M ? Y4m (d, s) : Raw (s);
+        while ( ATOMIC_LOAD (&d->written) != t ) ThreadYield ();
+        if ( fwrite (s->out, 1, size, d->f) != size ) ATOMIC_ADD (&d->errors, 1);
+        ATOMIC_STORE (&d->written, t + 1);
+    }
+    ATOMIC_STORE (&s->free, 1);
+}
+
+static void Worker (void *arg)
+{
+    Dump *d = (Dump *)arg;
+    long t;
+    int idle = 0;
+
+    while (1) {
+        t = ATOMIC_LOAD (&d->tail);
+        if ( t >= ATOMIC_LOAD (&d->head) ) {
+            if ( ATOMIC_LOAD (&d->quit) ) break;
+            if ( ++idle < 64 ) ThreadYield ();
+            else ThreadSleep (1);
+            continue;
+        }
+        if ( !ATOMIC_CAS (&d->tail, t, t + 1) ) continue;
+        idle = 0;
+        Encode (d, t);
+    }
+}
+
+// Emulation thread: frame to queue, encoded buffer of its slot back to PPU.
+static unsigned short * Hand (void *opaque, unsigned short *frame, long n)
+{
+    Dump *d = (Dump *)opaque;
+    DumpSlot *s = &d->slot[d->head % DUMP_QUEUE];
+    unsigned short *give;
+
+    while ( !ATOMIC_LOAD (&s->free) ) ThreadYield ();
+    give = s->pix;
+    s->pix = frame;
+    s->n = n;
+    s->free = 0;
+    if ( d->workers == 0 ) {
+        d->tail = d->head + 1;
+        Encode (d, d->head);
+    }
+    ATOMIC_STORE (&d->head, d->head + 1);
+    return give;
+}
+
+// ------------------------------------------------------------------------
+// API
+
+static void Palette (Dump *d)
+{
+    unsigned int pal[512];
+    int n, r, g, b;
+
+    NTSCPalette (pal);
+    for (n=0; n<512; n++) {
+        r = (pal[n] >> 16) & 255;
+        g = (pal[n] >> 8) & 255;
+        b = pal[n] & 255;
+        d->rgb[n][0] = (unsigned char)r;
+        d->rgb[n][1] = (unsigned char)g;
+        d->rgb[n][2] = (unsigned char)b;
+        d->yuv[n][0] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);      // BT.601, studio range
+        d->yuv[n][1] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        d->yuv[n][2] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+int DumpOpen (Dump *d, PPUFramebuffer *fb, int format, const char *path, int threads)
+{
+    DumpSlot *s;
+    int n, ok = 1;
+
+    memset (d, 0, sizeof(Dump));
+    if ( strlen (path) >= sizeof(d->path) ) return 0;
+    strcpy (d->path, path);
+    d->format = format;
+    Tables ();
+    Palette (d);
+
+    if ( format != DUMP_PNG ) {
+        d->f = fopen (path, "wb");
+        if ( d->f == NULL ) return 0;
+        if ( format == DUMP_Y4M ) fprintf (d->f, "YUV4MPEG2 W%d H%d F39375000:655171 Ip A8:7 C444\n", PPU_WIDTH, PPU_HEIGHT);
+    }
+
+    for (n=0; n<DUMP_QUEUE; n++) {
+        s = &d->slot[n];
+        s->pix = (unsigned short *)malloc (PIX_SIZE);
+        s->out = (unsigned char *)malloc (OUT_SIZE);
+        if ( format == DUMP_PNG ) {
+            s->raw = (unsigned char *)malloc (PNG_RAW);
+            s->hash = (int *)malloc (DUMP_HASH * sizeof(int));
+            if ( s->raw == NULL || s->hash == NULL ) ok = 0;
+        }
+        if ( s->pix == NULL || s->out == NULL ) ok = 0;
+        s->free = 1;
+    }
+    d->fb = fb;
+    if ( !ok ) {
+        DumpClose (d);
+        return 0;
+    }
+
+    if ( threads > DUMP_WORKERS ) threads = DUMP_WORKERS;
+    for (n=0; n<threads; n++) {
+        d->worker[d->workers] = ThreadCreate (Worker, d);
+        if ( d->worker[d->workers] ) d->workers++;
+    }
+    PPUSetFrameDone (fb, Hand, d);
+    return 1;
+}
+
+// Slots may hold framebuffer's own buffer instead of one allocated here, and one allocated buffer may be
+// PPU's back buffer: all allocated buffers are found by what was given away.
+long DumpClose (Dump *d)
+{
+    unsigned short *own0, *own1, *pool[DUMP_QUEUE + 1];
+    long errors;
+    int n, count = 0;
+
+    for (n=0; n<DUMP_QUEUE; n++) {
+        while ( !ATOMIC_LOAD (&d->slot[n].free) ) ThreadYield ();
+    }
+    ATOMIC_STORE (&d->quit, 1);
+    for (n=0; n<d->workers; n++) ThreadJoin (d->worker[n]);
+
+    own0 = &d->fb->pix[0][0][0];
+    own1 = &d->fb->pix[1][0][0];
+    for (n=0; n<DUMP_QUEUE; n++) {
+        if ( d->slot[n].pix != own0 && d->slot[n].pix != own1 ) pool[count++] = d->slot[n].pix;
+    }
+    if ( d->fb->done == Hand && d->fb->back != own0 && d->fb->back != own1 ) pool[count++] = d->fb->back;
+    if ( d->fb->done == Hand ) PPUSetFrameDone (d->fb, NULL, NULL);
+    for (n=0; n<count; n++) free (pool[n]);
+
+    for (n=0; n<DUMP_QUEUE; n++) {
+        free (d->slot[n].out);
+        free (d->slot[n].raw);
+        free (d->slot[n].hash);
+    }
+    if (d->f) fclose (d->f);
+    errors = d->errors;
+    memset (d, 0, sizeof(Dump));
+    return errors;
+}
@@ -0,0 +1,59 @@
+// Frame dumper: finished PPU frames to raw file, Y4M video or PNG files, encoded on background threads.
+//
+// Dumper takes over framebuffer hand-over (PPUSetFrameDone): finished frame goes to queue slot and slot's
+// previous buffer (encoded already) comes back to PPU for next frame, so emulation thread only swaps pointers.
+// When all slots are waiting for encode, PPU waits for one to be free (back-pressure).
+// Raw: 16-bit little-endian framebuffer pixels (color + emphasis), rows one after another, no header.
+// Y4M: 4:4:4 8-bit, 60.0988 fps, pixel aspect 8:7. PNG: 8-bit RGB, one file per frame, path is printf pattern
+// with frame number (%ld). Colors are NTSC decoder flat colors (NTSCPalette).
+// Raw and Y4M frames are written in order, whatever worker encodes them.
+#pragma once
+
+#include <stdio.h>
+#include "THREAD.h"
+#include "../BreaksPPU/PPU.h"
+
+enum {
+    DUMP_RAW,
+    DUMP_Y4M,
+    DUMP_PNG,
+};
+
+#define DUMP_QUEUE      8           // frames in queue (buffers owned by dumper)
+#define DUMP_WORKERS    4
+#define DUMP_HASH       (1 << 15)   // deflate match finder
+
+typedef struct DumpSlot
+{
+    unsigned short  *pix;       // frame
+    long    n;                  // frame number
+    volatile long   free;       // encoded (buffer can go back to PPU)
+    unsigned char   *raw;       // encoder input (PNG scanlines)
+    unsigned char   *out;       // encoded frame
+    int     *hash;
+} DumpSlot;
+
+typedef struct Dump
+{
+    PPUFramebuffer  *fb;
+    int     format;
+    char    path[260];
+    FILE    *f;                 // raw, Y4M
+    unsigned char   rgb[512][3];
+    unsigned char   yuv[512][3];
+
+    DumpSlot    slot[DUMP_QUEUE];
+    volatile long   head, tail; // frames queued, frames taken by workers
+    volatile long   written;    // frames written (raw, Y4M order)
+    volatile long   errors;     // frames not written
+    volatile long   quit;
+    Thread  worker[DUMP_WORKERS];
+    int     workers;
+} Dump;
+
+// Dump frames of framebuffer from next finished one. threads: encode workers (0: encode on emulation thread).
+// Returns 0 if output cannot be created or out of memory.
+int DumpOpen (Dump *d, PPUFramebuffer *fb, int format, const char *path, int threads);
+
+// Encode queued frames, give framebuffer back and close output. Returns frames not written.
+long DumpClose (Dump *d);
@@ -0,0 +1,222 @@
+// Farm runner.
+#include <stdlib.h>
+#include <string.h>
+#include "THREAD.h"
+#include "STATE.h"
+#include "MOVIE.h"
+#include "FARM.h"
+
+typedef struct Worker
+{
+    Farm    *farm;
+    int     index;
+    Thread  thread;
+} Worker;
+
+// ------------------------------------------------------------------------
+// Manifest
+
+int FarmLoad (Farm *farm, const char *manifest)
+{
+    FILE *f;
+    char line[1024], frames[32], movie[260], hash[32];
+    FarmTest *t;
+    long max = 0, num = 0;
+    void *p;
+    int n;
+
+    memset (farm, 0, sizeof(Farm));
+    f = fopen (manifest, "rt");
+    if (f == NULL) return 0;
+
+    while ( fgets (line, sizeof(line), f) ) {
+        num++;
+        for (n=0; line[n] == ' ' || line[n] == '\t'; n++) ;
+        if ( line[n] == '#' || line[n] == '\r' || line[n] == '\n' || line[n] == 0 ) continue;
+
+        if ( farm->count == max ) {
+            max = max ? max * 2 : 256;
+            p = realloc (farm->test, max * sizeof(FarmTest));
+            if (p == NULL) break;
+            farm->test = (FarmTest *)p;
+        }
+        t = &farm->test[farm->count];
+        memset (t, 0, sizeof(FarmTest));
+
+        if ( sscanf (line, "%63s %259s %31s %259s %31s", t->name, t->rom, frames, movie, hash) != 5 ) {
+            fprintf (stderr, "%s(%ld): expected: name rom frames movie hash\n", manifest, num);
+            continue;
+        }
+        t->frames = atol (frames);
+        if ( strcmp (movie, "-") ) strcpy (t->movie, movie);
+        if ( strcmp (hash, "-") ) {
+            t->expect = strtoul (hash, NULL, 16);
+            t->has_expect = 1;
+        }
+        t->desync = -1;
+        farm->count++;
+    }
+    fclose (f);
+    return 1;
+}
+
+void FarmFree (Farm *farm)
+{
+    free (farm->test);
+    memset (farm, 0, sizeof(Farm));
+}
+
+// ------------------------------------------------------------------------
+// Workers
+
+static void Input (void *opaque, ContextNES *nes, const unsigned char pad[2])
+{
+    (void)opaque;
+    JoypadSet (&nes->pads, 0, pad[0]);
+    JoypadSet (&nes->pads, 1, pad[1]);
+}
+
+static void RunTest (FarmTest *t, ContextNES *nes, unsigned char *state, unsigned long state_size)
+{
+    Movie mv;
+    unsigned long h;
+    int play;
+    double start = ThreadTime ();
+
+    memset (&mv, 0, sizeof(mv));
+    mv.input = Input;
+    t->chain = 2166136261u;
+
+    NESInit (nes);
+    if ( !NESLoad (nes, t->rom) ) {
+        t->status = FARM_ERROR;
+        return;
+    }
+    play = t->movie[0] != 0;
+    if ( play && !MoviePlay (&mv, nes, t->movie) ) {
+        t->status = FARM_ERROR;
+        CartUnload (&nes->cart);
+        return;
+    }
+
+    while ( t->frames == 0 || t->ran < t->frames ) {
+        if (play) {
+            if ( !MoviePlayFrame (&mv) ) break;
+            h = mv.frame[mv.pos - 1].hash;     // checked by movie, no second hashing
+            if ( mv.desync >= 0 ) {
+                NESStateWrite (nes, state);
+                h = MovieHash (state, state_size);
+            }
+        }
+        else {
+            if ( t->frames == 0 ) break;
+            NESRun (nes, nes->clk + NES_FRAME);
+            NESStateWrite (nes, state);
+            h = MovieHash (state, state_size);
+        }
+        t->chain = ((t->chain ^ h) * 16777619u) & 0xffffffff;
+        t->hash = h;
+        t->ran++;
+    }
+
+    t->desync = play ? mv.desync : -1;
+    t->status = FARM_PASS;
+    if ( play && mv.desync >= 0 ) t->status = FARM_FAIL;
+    if ( t->has_expect && t->hash != t->expect ) t->status = FARM_FAIL;
+
+    if (play) MovieClose (&mv);
+    CartUnload (&nes->cart);
+    t->wall = ThreadTime () - start;
+}
+
+static void WorkerProc (void *arg)
+{
+    Worker *w = (Worker *)arg;
+    Farm *farm = w->farm;
+    ContextNES *nes;
+    unsigned char *state;
+    unsigned long state_size, size;
+    long n;
+
+    // Board and state buffer in one block, local to this core.
+    ThreadPin (w->index);
+    state_size = NESStateSize (NULL);
+    size = (sizeof(ContextNES) + 63) & ~63UL;
+    nes = (ContextNES *)ThreadAlloc (size + state_size);
+    if (nes == NULL) return;
+    state = (unsigned char *)nes + size;
+
+    while ( (n = ATOMIC_ADD (&farm->next, 1)) < farm->count ) {
+        farm->test[n].worker = w->index;
+        RunTest (&farm->test[n], nes, state, state_size);
+    }
+
+    ThreadFree (nes, size + state_size);
+}
+
+void FarmRun (Farm *farm, int workers)
+{
+    Worker *w;
+    Image *img;
+    double start;
+    int n;
+
+    if ( workers <= 0 ) workers = ThreadCores ();
+    if ( workers > farm->count ) workers = farm->count > 0 ? (int)farm->count : 1;
+    farm->workers = workers;
+    farm->next = 0;
+
+    // Keep ROM images mapped for the whole run, tests then only find them in image cache.
+    img = (Image *)calloc (farm->count + 1, sizeof(Image));
+    for (n=0; img && n<farm->count; n++) ImageOpen (&img[n], farm->test[n].rom);
+
+    start = ThreadTime ();
+    w = (Worker *)calloc (workers, sizeof(Worker));
+    for (n=0; w && n<workers; n++) {
+        w[n].farm = farm;
+        w[n].index = n;
+        w[n].thread = ThreadCreate (WorkerProc, &w[n]);
+    }
+    for (n=0; w && n<workers; n++) ThreadJoin (w[n].thread);
+    if ( farm->next < farm->count ) {       // threads could not be created, run rest here
+        Worker self;
+        self.farm = farm;
+        self.index = 0;
+        WorkerProc (&self);
+    }
+    farm->wall = ThreadTime () - start;
+    free (w);
+
+    for (n=0; img && n<farm->count; n++) {
+        if (img[n].data) ImageClose (&img[n]);
+    }
+    free (img);
+}
+
+// ------------------------------------------------------------------------
+// Report
+
+long FarmReport (Farm *farm, FILE *f)
+{
+    static char *status[] = { "SKIP", "PASS", "FAIL", "ERROR" };
+    FarmTest *t;
+    long n, bad = 0, frames = 0;
+    double emulated, cpu = 0;
+
+    for (n=0; n<farm->count; n++) {
+        t = &farm->test[n];
+        emulated = FARM_SECONDS(t->ran);
+        fprintf (f, "%-5s %-24s frames %7ld  hash %08lx  chain %08lx", status[t->status], t->name, t->ran, t->hash, t->chain);
+        if ( t->desync >= 0 ) fprintf (f, "  desync %ld", t->desync);
+        fprintf (f, "  %.2f s  x%.2f  worker %d\n", t->wall, t->wall > 0 ? emulated / t->wall : 0, t->worker);
+        if ( t->status != FARM_PASS ) bad++;
+        frames += t->ran;
+        cpu += t->wall;
+    }
+
+    emulated = FARM_SECONDS(frames);
+    fprintf (f, "%ld tests, %ld passed, %ld failed, %d workers\n", farm->count, farm->count - bad, bad, farm->workers);
+    fprintf (f, "%ld frames, %.1f emulated s in %.2f wall s: x%.2f total, x%.2f per worker\n",
+        frames, emulated, farm->wall, farm->wall > 0 ? emulated / farm->wall : 0, cpu > 0 ? emulated / cpu : 0);
+    return bad;
+}
@@ -0,0 +1,61 @@
+// Farm runner: many headless boards over all cores for regression corpora.
+//
+// Manifest is text file, one test per line ('#' starts comment):
+//      name  rom  frames  movie  hash
+// frames: frames to run from power-on (0 with movie: whole movie). movie: controller movie or '-'.
+// hash: expected state hash after last frame (hex) or '-'. Test with movie also fails on movie desync.
+//
+// One worker per core, pinned. Each worker allocates its board once, on its own NUMA node,
+// and reuses it for all tests it takes, so run time is emulation only. ROM images are mapped once per process.
+#pragma once
+
+#include <stdio.h>
+#include "BOARD.h"
+
+enum {
+    FARM_PENDING,
+    FARM_PASS,
+    FARM_FAIL,
+    FARM_ERROR,     // ROM or movie cannot be loaded
+};
+
+typedef struct FarmTest
+{
+    char    name[64];
+    char    rom[260];
+    char    movie[260];         // empty: none
+    long    frames;
+    unsigned long   expect;
+    int     has_expect;
+
+    // Results
+    int     status;
+    long    ran;                // frames executed
+    unsigned long   hash;       // state hash after last frame
+    unsigned long   chain;      // hash of all per-frame state hashes
+    long    desync;             // first desynced movie frame, -1: none
+    double  wall;               // seconds
+    int     worker;
+} FarmTest;
+
+typedef struct Farm
+{
+    FarmTest    *test;
+    long    count;
+    volatile long   next;       // next test to take
+    int     workers;
+    double  wall;
+} Farm;
+
+// Returns 0 if manifest cannot be read. Bad lines are reported to stderr and skipped.
+int FarmLoad (Farm *farm, const char *manifest);
+void FarmFree (Farm *farm);
+
+// workers: 0 for all cores.
+void FarmRun (Farm *farm, int workers);
+
+// Per-test lines and totals. Returns number of tests not passed.
+long FarmReport (Farm *farm, FILE *f);
+
+// Emulated seconds for frames.
+#define FARM_SECONDS(frames)    ((double)(frames) * NES_FRAME / 42954545.0)
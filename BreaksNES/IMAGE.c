@@ -0,0 +1,144 @@
+// Read-only ROM images mapped from disk.
+#include <stdlib.h>
+#include <string.h>
+#include "THREAD.h"
+#include "IMAGE.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Open mappings. Images are few, list is enough.
+typedef struct Mapping
+{
+    struct Mapping  *next;
+    char    *path;
+    const unsigned char *data;
+    unsigned long   size;
+    long    refs;
+} Mapping;
+
+static Mapping *mappings;
+static volatile long lock;
+
+static void Lock (void)
+{
+    while ( !ATOMIC_CAS (&lock, 0, 1) ) ThreadYield ();
+}
+
+static void Unlock (void)
+{
+    ATOMIC_STORE (&lock, 0);
+}
+
+static const unsigned char * MapFile (const char *path, unsigned long *size)
+{
+#ifdef _WIN32
+    HANDLE file, map;
+    LARGE_INTEGER len;
+    void *data;
+
+    file = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    if ( !GetFileSizeEx (file, &len) || len.QuadPart == 0 ) {
+        CloseHandle (file);
+        return NULL;
+    }
+    map = CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle (file);
+    if (map == NULL) return NULL;
+    data = MapViewOfFile (map, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle (map);      // view keeps mapping alive
+    *size = (unsigned long)len.QuadPart;
+    return (const unsigned char *)data;
+#else
+    struct stat st;
+    void *data;
+    int fd = open (path, O_RDONLY);
+
+    if (fd < 0) return NULL;
+    if ( fstat (fd, &st) || st.st_size == 0 ) {
+        close (fd);
+        return NULL;
+    }
+    data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);             // mapping keeps file referenced
+    if (data == MAP_FAILED) return NULL;
+    *size = (unsigned long)st.st_size;
+    return (const unsigned char *)data;
+#endif
+}
+
+static void UnmapFile (const unsigned char *data, unsigned long size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile (data);
+#else
+    munmap ((void *)data, size);
+#endif
+}
+
+int ImageOpen (Image *img, const char *path)
+{
+    Mapping *m;
+
+    img->data = NULL;
+    img->size = 0;
+
+    Lock ();
+    for (m=mappings; m; m=m->next) {
+        if ( !strcmp (m->path, path) ) break;
+    }
+    if (m == NULL) {
+        m = (Mapping *)malloc (sizeof(Mapping));
+        if (m) m->path = (char *)malloc (strlen(path) + 1);
+        if (m == NULL || m->path == NULL) {
+            free (m);
+            Unlock ();
+            return 0;
+        }
+        strcpy (m->path, path);
+        m->data = MapFile (path, &m->size);
+        if (m->data == NULL) {
+            free (m->path);
+            free (m);
+            Unlock ();
+            return 0;
+        }
+        m->refs = 0;
+        m->next = mappings;
+        mappings = m;
+    }
+    m->refs++;
+    img->data = m->data;
+    img->size = m->size;
+    Unlock ();
+    return 1;
+}
+
+void ImageClose (Image *img)
+{
+    Mapping **p, *m;
+
+    if (img->data == NULL) return;
+
+    Lock ();
+    for (p=&mappings; (m = *p) != NULL; p=&m->next) {
+        if (m->data == img->data) break;
+    }
+    if ( m && --m->refs == 0 ) {
+        *p = m->next;
+        UnmapFile (m->data, m->size);
+        free (m->path);
+        free (m);
+    }
+    Unlock ();
+
+    img->data = NULL;
+    img->size = 0;
+}
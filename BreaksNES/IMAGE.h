@@ -0,0 +1,14 @@
+// Read-only ROM images mapped from disk.
+// Same file opened again in this process returns the same mapping. Other processes mapping the same file
+// share the same physical pages through page cache, so there is only one copy of the data in memory.
+#pragma once
+
+typedef struct Image
+{
+    const unsigned char *data;
+    unsigned long   size;
+} Image;
+
+// Returns 0 if file cannot be opened or mapped.
+int ImageOpen (Image *img, const char *path);
+void ImageClose (Image *img);
@@ -0,0 +1,120 @@
+// Standard controllers on 2A03 I/O port.
+#include <string.h>
+#include "JOYPAD.h"
+
+// Controller wiring: P8 = A ... P1 = Right (pressed: low), P/S = OUT0, CLK = /INx, SER = GND.
+static void StepPort (Joypads *jp, int port)
+{
+    JoypadState *s = &jp->state;
+    Context4021 *sr = &s->sr[port];
+    int i;
+
+    for (i=0; i<8; i++) sr->P[7-i] = !((s->buttons[port] >> i) & 1);
+    sr->PS = (char)jp->apu->pad[APU_OUT0];
+    sr->CLK = (char)jp->apu->pad[APU_IN0 + port];
+    sr->SER = 0;
+    Step4021 (sr);
+}
+
+void JoypadInit (Joypads *jp, ContextAPU *apu)
+{
+    JoypadState *s = &jp->state;
+    int port, i;
+
+    memset (jp, 0, sizeof(Joypads));
+    jp->apu = apu;
+    apu->pad[APU_IN0] = apu->pad[APU_IN1] = 1;
+
+    for (port=0; port<2; port++) {
+        for (i=0; i<8; i++) s->sr[port].Q[i] = 1;
+        s->sr[port].CLK_old = 1;
+        StepPort (jp, port);
+    }
+}
+
+void JoypadSet (Joypads *jp, int port, unsigned char buttons)
+{
+    jp->state.buttons[port & 1] = buttons;
+    if (jp->state.gate) StepPort (jp, port & 1);
+}
+
+void JoypadGate (Joypads *jp, int gate)
+{
+    JoypadState *s = &jp->state;
+    int port, i;
+
+    if ( !gate == !s->gate ) return;
+
+    if (gate) {
+        for (port=0; port<2; port++) {
+            for (i=0; i<8; i++) s->sr[port].Q[7-i] = !((s->shift[port] >> i) & 1);
+            s->sr[port].CLK_old = 1;
+            StepPort (jp, port);
+        }
+    }
+    else {
+        JOYPAD_RELEASE (jp);
+        for (port=0; port<2; port++) {
+            s->shift[port] = 0;
+            for (i=0; i<8; i++) s->shift[port] |= !s->sr[port].Q[7-i] << i;
+        }
+    }
+    s->gate = gate != 0;
+}
+
+unsigned char JoypadRead (Joypads *jp, unsigned short addr, unsigned char bus)
+{
+    JoypadState *s = &jp->state;
+    int port = addr - 0x4016, d0;
+
+    if ( port != 0 && port != 1 ) return bus;
+
+    if (s->gate) {
+        jp->apu->pad[APU_IN0 + port] = 0;
+        s->oe |= 1 << port;
+        StepPort (jp, port);
+        d0 = !s->sr[port].Q8;
+    }
+    else if (s->strobe) d0 = s->buttons[port] & 1;
+    else {
+        d0 = s->shift[port] & 1;
+        s->shift[port] = (s->shift[port] >> 1) | 0x80;     // shift at release of /INx comes before next read anyway
+    }
+    return (bus & 0xe0) | d0;
+}
+
+void JoypadWrite (Joypads *jp, unsigned short addr, unsigned char data)
+{
+    JoypadState *s = &jp->state;
+    ContextAPU *apu = jp->apu;
+
+    if ( addr != 0x4016 ) return;
+
+    apu->pad[APU_OUT0] = data & 1;
+    apu->pad[APU_OUT1] = (data >> 1) & 1;
+    apu->pad[APU_OUT2] = (data >> 2) & 1;
+
+    if (s->gate) {
+        StepPort (jp, 0);
+        StepPort (jp, 1);
+    }
+    else if ( s->strobe || (data & 1) ) {      // registers hold buttons seen while P/S was high
+        s->shift[0] = s->buttons[0];
+        s->shift[1] = s->buttons[1];
+    }
+    s->strobe = data & 1;
+}
+
+void JoypadRelease (Joypads *jp)
+{
+    JoypadState *s = &jp->state;
+    int port;
+
+    for (port=0; port<2; port++) {
+        if ( s->oe & (1 << port) ) {
+            jp->apu->pad[APU_IN0 + port] = 1;
+            StepPort (jp, port);
+        }
+    }
+    s->oe = 0;
+}
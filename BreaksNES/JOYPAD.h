@@ -0,0 +1,60 @@
+// Standard controllers on 2A03 I/O port.
+//
+// Console side: writing $4016 sets 2A03 OUT0-OUT2 latch, OUT0 goes to P/S of both controllers.
+// Reading $4016 / $4017 pulls /IN0 / /IN1 low for the PHI2 of the read. It is CLK of controller 1 / 2 shift register
+// and enables inverting buffer (74HC368) that puts Q8 on D0. Shift happens when /INx goes high again at end of read.
+// Buttons pull P inputs low when pressed, SER is grounded, so after 8 reads D0 stays 1.
+//
+// Two paths:
+// - gate: 2A03 pads APU_OUT0-2 / APU_IN0-1 are driven and CD4021 models are stepped at every pad change;
+// - fast (default): serial bits are served directly from packed button byte on CPU read through page table.
+// State of both paths is kept in step when switching.
+#pragma once
+
+#include "../BreaksAPU/APU.h"
+#include "CD4021.h"
+
+// Buttons in packed byte, in serial order.
+enum {
+    JOYPAD_A = 0x01,
+    JOYPAD_B = 0x02,
+    JOYPAD_SELECT = 0x04,
+    JOYPAD_START = 0x08,
+    JOYPAD_UP = 0x10,
+    JOYPAD_DOWN = 0x20,
+    JOYPAD_LEFT = 0x40,
+    JOYPAD_RIGHT = 0x80,
+};
+
+// Plain data (saved in states).
+typedef struct JoypadState
+{
+    int     gate;               // 1: gate path
+    unsigned char   buttons[2]; // pressed buttons (1)
+    unsigned char   strobe;     // OUT0 latch
+    unsigned char   shift[2];   // fast path: bits not read yet (bit 0 next, 1: pressed)
+    unsigned char   oe;         // /IN0 (bit 0), /IN1 (bit 1) held low by current read
+    Context4021     sr[2];      // gate path
+} JoypadState;
+
+typedef struct Joypads
+{
+    JoypadState state;
+    ContextAPU  *apu;           // I/O port pads
+} Joypads;
+
+void JoypadInit (Joypads *jp, ContextAPU *apu);
+
+// Set pressed buttons of controller (port 0 / 1).
+void JoypadSet (Joypads *jp, int port, unsigned char buttons);
+
+// Switch between gate and fast path.
+void JoypadGate (Joypads *jp, int gate);
+
+// CPU access to $4016 / $4017 (page table device MEM_DEVICE_IO). bus: open bus value for undriven bits.
+unsigned char JoypadRead (Joypads *jp, unsigned short addr, unsigned char bus);
+void JoypadWrite (Joypads *jp, unsigned short addr, unsigned char data);
+
+// End of PHI2: /IN0 /IN1 go high, shift registers of read controllers are clocked.
+#define JOYPAD_RELEASE(jp)  { if ((jp)->state.oe) JoypadRelease (jp); }
+void JoypadRelease (Joypads *jp);
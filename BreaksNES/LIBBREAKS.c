@@ -0,0 +1,246 @@
+// libbreaks C ABI.
+#include <stdlib.h>
+#include <string.h>
+#include "BOARD.h"
+#include "CORES.h"
+#include "DUMP.h"
+#include "NTSC.h"
+#include "STATE.h"
+#define BREAKS_BUILD
+#include "LIBBREAKS.h"
+
+struct breaks
+{
+    ContextNES  nes;
+    PPUFramebuffer  fb;
+    NTSC    *tv;            // NULL: decoder off
+    Dump    *dump;          // NULL: not dumping
+    PPUEventLog log;        // ring NULL: not logging
+    breaks_trace_fn trace;
+    void    *user;
+    int     chips;
+    CoresNES    cores;
+    int     threaded;       // run untraced batches on two pinned threads
+};
+
+BREAKS_API int breaks_version (void)
+{
+    return BREAKS_ABI_VERSION;
+}
+
+BREAKS_API breaks_t * breaks_create (void)
+{
+    breaks_t *b = (breaks_t *)calloc (1, sizeof(breaks_t));
+    if (b == NULL) return NULL;
+    NESInit (&b->nes);
+    PPUSetFramebuffer (&b->nes.ppu, &b->fb);
+    return b;
+}
+
+BREAKS_API void breaks_destroy (breaks_t *b)
+{
+    if (b == NULL) return;
+    breaks_set_ntsc (b, -1);
+    breaks_dump (b, -1, NULL, 0);
+    breaks_ppu_log (b, 0);
+    CartUnload (&b->nes.cart);
+    free (b);
+}
+
+BREAKS_API int breaks_load (breaks_t *b, const char *path)
+{
+    CartUnload (&b->nes.cart);
+    return NESLoad (&b->nes, path);
+}
+
+BREAKS_API void breaks_reset (breaks_t *b, int nres)
+{
+    NESReset (&b->nes, nres);
+}
+
+// Traced run goes edge by edge, otherwise whole batch is one NESRun (or NESRunCores).
+static unsigned long long Run (breaks_t *b, unsigned long long until)
+{
+    ContextNES *nes = &b->nes;
+    unsigned long long t;
+    int mask, chips;
+
+    if ( b->trace == NULL ) {
+        if (b->threaded) NESRunCores (&b->cores, nes, until);
+        else NESRun (nes, until);
+        return nes->clk;
+    }
+
+    while (1) {
+        t = nes->next[NES_CHIP_PPU] < nes->next[NES_CHIP_CPU] ? nes->next[NES_CHIP_PPU] : nes->next[NES_CHIP_CPU];
+        if ( t >= until ) break;
+        mask = NESStep (nes);
+        chips = 0;
+        if ( mask & (1 << NES_CHIP_CPU) ) chips |= BREAKS_CHIP_CPU | BREAKS_CHIP_APU;
+        if ( mask & (1 << NES_CHIP_PPU) ) chips |= BREAKS_CHIP_PPU;
+        if ( chips & b->chips ) b->trace (b->user, chips & b->chips, t);
+    }
+    nes->clk = until;
+    return nes->clk;
+}
+
+BREAKS_API unsigned long long breaks_run_cycles (breaks_t *b, unsigned long long n)
+{
+    return Run (b, b->nes.clk + n * 2 * NES_CPU_DIVIDER);
+}
+
+BREAKS_API unsigned long long breaks_run_frames (breaks_t *b, unsigned long long n)
+{
+    return Run (b, b->nes.clk + n * NES_FRAME);
+}
+
+BREAKS_API unsigned long long breaks_run_ticks (breaks_t *b, unsigned long long n)
+{
+    return Run (b, b->nes.clk + n);
+}
+
+BREAKS_API void breaks_set_cores (breaks_t *b, int enable, int core, unsigned long quantum)
+{
+    b->threaded = enable;
+    b->cores.core = core;
+    b->cores.quantum = quantum;
+}
+
+BREAKS_API unsigned long long breaks_clock (breaks_t *b)
+{
+    return b->nes.clk;
+}
+
+BREAKS_API void breaks_set_buttons (breaks_t *b, int port, unsigned buttons)
+{
+    JoypadSet (&b->nes.pads, port, (unsigned char)buttons);
+}
+
+static unsigned int * PPUPad (breaks_t *b, int chip, int pad)
+{
+    if ( chip == BREAKS_CHIP_PPU && pad >= 0 && (unsigned)pad < sizeof(b->nes.ppu.pad) / sizeof(b->nes.ppu.pad[0]) ) return &b->nes.ppu.pad[pad];
+    return NULL;
+}
+
+static unsigned long * APUPad (breaks_t *b, int chip, int pad)
+{
+    if ( (chip == BREAKS_CHIP_CPU || chip == BREAKS_CHIP_APU) && pad >= 0 && pad < APU_PAD_MAX ) return &b->nes.apu.pad[pad];
+    return NULL;
+}
+
+BREAKS_API unsigned long breaks_pad_get (breaks_t *b, int chip, int pad)
+{
+    unsigned int *pp = PPUPad (b, chip, pad);
+    unsigned long *ap = APUPad (b, chip, pad);
+    return pp ? *pp : ap ? *ap : 0;
+}
+
+BREAKS_API void breaks_pad_set (breaks_t *b, int chip, int pad, unsigned long value)
+{
+    unsigned int *pp = PPUPad (b, chip, pad);
+    unsigned long *ap = APUPad (b, chip, pad);
+    if (pp) *pp = (unsigned int)value;
+    if (ap) *ap = value;
+}
+
+BREAKS_API unsigned char * breaks_memory (breaks_t *b, int region, unsigned long *size)
+{
+    ContextNES *nes = &b->nes;
+    unsigned char *mem = NULL;
+    unsigned long len = 0;
+
+    switch (region) {
+        case BREAKS_MEM_RAM: mem = nes->ram; len = sizeof(nes->ram); break;
+        case BREAKS_MEM_VRAM: mem = nes->ciram; len = sizeof(nes->ciram); break;
+        case BREAKS_MEM_OAM: mem = nes->ppu.mem + PPU_MEM_OAM; len = 256; break;
+        case BREAKS_MEM_PALETTE: mem = nes->ppu.mem + PPU_PALETTE; len = 32; break;
+        case BREAKS_MEM_PRGRAM: mem = nes->cart.state.prg_ram; len = sizeof(nes->cart.state.prg_ram); break;
+    }
+    if (size) *size = len;
+    return mem;
+}
+
+BREAKS_API const unsigned short * breaks_frame (breaks_t *b, long *frames)
+{
+    return PPUFrame (&b->fb, frames);
+}
+
+BREAKS_API int breaks_set_ntsc (breaks_t *b, int threads)
+{
+    if (b->tv) {
+        NTSCFree (b->tv);
+        free (b->tv);
+        b->tv = NULL;
+    }
+    if ( threads < 0 ) return 1;
+    b->tv = (NTSC *)malloc (sizeof(NTSC));
+    if ( b->tv && NTSCInit (b->tv, &b->nes.ppu, threads) ) return 1;
+    free (b->tv);
+    b->tv = NULL;
+    return 0;
+}
+
+BREAKS_API const unsigned int * breaks_frame_ntsc (breaks_t *b, long *frames)
+{
+    if ( b->tv == NULL ) {
+        if (frames) *frames = 0;
+        return NULL;
+    }
+    return NTSCFrame (b->tv, frames);
+}
+
+BREAKS_API int breaks_dump (breaks_t *b, int format, const char *path, int threads)
+{
+    if (b->dump) {
+        DumpClose (b->dump);
+        free (b->dump);
+        b->dump = NULL;
+    }
+    if ( format < 0 ) return 1;
+    b->dump = (Dump *)malloc (sizeof(Dump));
+    if ( b->dump && DumpOpen (b->dump, &b->fb, format, path, threads) ) return 1;
+    free (b->dump);
+    b->dump = NULL;
+    return 0;
+}
+
+BREAKS_API int breaks_ppu_log (breaks_t *b, unsigned long events)
+{
+    PPUSetLog (&b->nes.ppu, NULL);
+    PPULogFree (&b->log);
+    if ( events == 0 ) return 1;
+    if ( !PPULogInit (&b->log, events) ) {
+        PPULogFree (&b->log);
+        return 0;
+    }
+    PPUSetLog (&b->nes.ppu, &b->log);
+    return 1;
+}
+
+BREAKS_API int breaks_ppu_log_save (breaks_t *b, const char *path)
+{
+    return b->log.ring ? PPULogSave (&b->log, path) : 0;
+}
+
+BREAKS_API unsigned long breaks_snapshot_size (breaks_t *b)
+{
+    return NESStateSize (&b->nes);
+}
+
+BREAKS_API unsigned long breaks_snapshot_save (breaks_t *b, void *buf, unsigned long size)
+{
+    if ( size < NESStateSize (&b->nes) ) return 0;
+    return NESStateWrite (&b->nes, (unsigned char *)buf);
+}
+
+BREAKS_API int breaks_snapshot_load (breaks_t *b, const void *buf, unsigned long size)
+{
+    return NESStateRead (&b->nes, (const unsigned char *)buf, size);
+}
+
+BREAKS_API void breaks_set_trace (breaks_t *b, int chips, breaks_trace_fn fn, void *user)
+{
+    b->trace = fn;
+    b->user = user;
+    b->chips = chips;
+}
@@ -0,0 +1,110 @@
+// libbreaks: headless NES board (2A03 + PPU + cartridge) behind plain C ABI, for embedding in test tools.
+//
+// Handle is opaque and all arguments are plain integers and pointers, so layout of chip contexts can change
+// without breaking callers. Run calls execute any number of chip edges inside the library; trace hook is
+// the only per-edge callback and is used only when set.
+// Pad numbers are APU_xxx (BreaksAPU/APU.h) and PPU_xxx (BreaksPPU/PPU.h) enums.
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#ifdef BREAKS_BUILD
+#define BREAKS_API  __declspec(dllexport)
+#else
+#define BREAKS_API  __declspec(dllimport)
+#endif
+#else
+#define BREAKS_API  __attribute__((visibility("default")))
+#endif
+
+#define BREAKS_ABI_VERSION  2
+
+typedef struct breaks breaks_t;
+
+// Chips (bit mask for trace). 6502 core and APU are one chip (2A03) and are stepped together.
+enum {
+    BREAKS_CHIP_CPU = 1,
+    BREAKS_CHIP_APU = 2,
+    BREAKS_CHIP_PPU = 4,
+};
+
+// Memory regions.
+enum {
+    BREAKS_MEM_RAM,         // 2 KB CPU RAM
+    BREAKS_MEM_VRAM,        // 2 KB nametable RAM
+    BREAKS_MEM_OAM,         // 256 bytes
+    BREAKS_MEM_PALETTE,     // 32 bytes
+    BREAKS_MEM_PRGRAM,      // 8 KB cartridge RAM
+};
+
+// Frame dump formats (BreaksNES/DUMP.h).
+enum {
+    BREAKS_DUMP_RAW,        // 16-bit framebuffer pixels, one file
+    BREAKS_DUMP_Y4M,        // video, one file
+    BREAKS_DUMP_PNG,        // path is printf pattern with frame number (%ld)
+};
+
+// Called after edge of traced chips. clk: master clock tick of edge.
+typedef void (*breaks_trace_fn) (void *user, int chips, unsigned long long clk);
+
+BREAKS_API int breaks_version (void);
+
+BREAKS_API breaks_t * breaks_create (void);
+BREAKS_API void breaks_destroy (breaks_t *b);
+
+// Insert cartridge (iNES / NES 2.0). Returns 0 on error.
+BREAKS_API int breaks_load (breaks_t *b, const char *path);
+BREAKS_API void breaks_reset (breaks_t *b, int nres);
+
+// Run CPU cycles (PHI0 periods, 24 master ticks), frames (262 lines) or master ticks. Return master clock after run.
+BREAKS_API unsigned long long breaks_run_cycles (breaks_t *b, unsigned long long n);
+BREAKS_API unsigned long long breaks_run_frames (breaks_t *b, unsigned long long n);
+BREAKS_API unsigned long long breaks_run_ticks (breaks_t *b, unsigned long long n);
+BREAKS_API unsigned long long breaks_clock (breaks_t *b);
+
+// Run 2A03 and PPU on two threads (BreaksNES/CORES.h), pinned from core (-1: not pinned). quantum: 2A03
+// run-ahead over PPU in master ticks, 0: same result as single thread. Traced runs stay single-threaded.
+BREAKS_API void breaks_set_cores (breaks_t *b, int enable, int core, unsigned long quantum);
+
+// Controllers (bit 0: A ... bit 7: Right).
+BREAKS_API void breaks_set_buttons (breaks_t *b, int port, unsigned buttons);
+
+// Chip pads (chip: BREAKS_CHIP_CPU / APU share pads). Out of range pads read 0.
+BREAKS_API unsigned long breaks_pad_get (breaks_t *b, int chip, int pad);
+BREAKS_API void breaks_pad_set (breaks_t *b, int chip, int pad, unsigned long value);
+
+// Memory region, size is returned in *size. Writable.
+BREAKS_API unsigned char * breaks_memory (breaks_t *b, int region, unsigned long *size);
+
+// Last finished frame: 240 rows of 256 pixels, palette color in bits 0-5 and emphasis R, G, B in bits 6-8.
+// Not copied: valid until next frame is finished; frames finished so far in *frames (may be NULL).
+BREAKS_API const unsigned short * breaks_frame (breaks_t *b, long *frames);
+
+// NTSC decoder on composite output (BreaksNES/NTSC.h). threads: decode workers, < 0: off. Returns 0 if out of memory.
+BREAKS_API int breaks_set_ntsc (breaks_t *b, int threads);
+
+// Last decoded frame: 240 rows of 512 pixels 0x00RRGGBB, NULL if decoder is off. Same lifetime as breaks_frame.
+BREAKS_API const unsigned int * breaks_frame_ntsc (breaks_t *b, long *frames);
+
+// Dump finished frames from next one on, encoded by threads workers (0: on emulation thread). format < 0: stop.
+// Returns 0 if output cannot be created. breaks_frame keeps working while dumping.
+BREAKS_API int breaks_dump (breaks_t *b, int format, const char *path, int threads);
+
+// Log PPU control line transitions into ring of events entries (0: stop), save log for BreaksNES/hvlog.
+BREAKS_API int breaks_ppu_log (breaks_t *b, unsigned long events);
+BREAKS_API int breaks_ppu_log_save (breaks_t *b, const char *path);
+
+// Snapshots (savestate format of BreaksNES/STATE.h).
+BREAKS_API unsigned long breaks_snapshot_size (breaks_t *b);
+BREAKS_API unsigned long breaks_snapshot_save (breaks_t *b, void *buf, unsigned long size);    // 0: buffer too small
+BREAKS_API int breaks_snapshot_load (breaks_t *b, const void *buf, unsigned long size);
+
+// chips: mask of traced chips, fn NULL: no trace.
+BREAKS_API void breaks_set_trace (breaks_t *b, int chips, breaks_trace_fn fn, void *user);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,132 @@
+// CPU address space page table.
+#include <string.h>
+#include "../BreaksPPU/PPU.h"
+#include "MEMMAP.h"
+#include "BOARD.h"
+
+void MemInit (MemoryMap *mm)
+{
+    memset (mm, 0, sizeof(MemoryMap));
+}
+
+void MemMapHost (MemoryMap *mm, int first, int last, unsigned char *mem, unsigned long size, int write)
+{
+    int n;
+    unsigned long offset = 0;
+
+    for (n=first; n<=last; n++) {
+        mm->page[n].read = mem + offset;
+        mm->page[n].write = write ? mem + offset : NULL;
+        offset = (offset + MEM_PAGE_SIZE) % size;
+    }
+}
+
+void MemMapDevice (MemoryMap *mm, int first, int last, int device, void *ctx)
+{
+    int n;
+    for (n=first; n<=last; n++) {
+        memset ( &mm->page[n], 0, sizeof(MemoryPage) );
+        mm->page[n].device = device;
+        mm->page[n].ctx = ctx;
+    }
+}
+
+void MemMapHandler (MemoryMap *mm, int first, int last, void *ctx,
+    unsigned char (*rd) (void *ctx, unsigned short addr, unsigned char bus),
+    void (*wr) (void *ctx, unsigned short addr, unsigned char data) )
+{
+    int n;
+    MemMapDevice (mm, first, last, MEM_DEVICE_HANDLER, ctx);
+    for (n=first; n<=last; n++) {
+        mm->page[n].rd = rd;
+        mm->page[n].wr = wr;
+    }
+}
+
+// ------------------------------------------------------------------------
+// Devices
+
+// PPU register access only drives PPU pads, register logic works on next PPU steps.
+// Read data is taken at once: PPU read data path has no clock.
+static void PPUSelect (MemoryMap *mm, ContextPPU *ppu, unsigned short addr, int rw)
+{
+    ppu->pad[PPU_RS] = addr & 7;
+    ppu->pad[PPU_RW] = rw;
+    ppu->pad[PPU_nDBE] = 0;
+    mm->dbe = ppu;
+}
+
+unsigned char MemReadDevice (MemoryMap *mm, unsigned short addr)
+{
+    MemoryPage *page = &mm->page[MEM_PAGE(addr)];
+    ContextPPU *ppu;
+
+    switch (page->device) {
+        case MEM_DEVICE_PPU:
+            ppu = (ContextPPU *)page->ctx;
+            PPUSelect (mm, ppu, addr, 1);
+            PPUDrive (ppu);
+            mm->bus = (unsigned char)ppu->pad[PPU_D];
+            break;
+        case MEM_DEVICE_IO:
+            if (page->ctx) mm->bus = NESReadIO ((ContextNES *)page->ctx, addr, mm->bus);
+            break;
+        case MEM_DEVICE_HANDLER:
+            if (page->rd) mm->bus = page->rd (page->ctx, addr, mm->bus);
+            break;
+    }
+    return mm->bus;
+}
+
+void MemWriteDevice (MemoryMap *mm, unsigned short addr, unsigned char data)
+{
+    MemoryPage *page = &mm->page[MEM_PAGE(addr)];
+    ContextPPU *ppu;
+
+    mm->bus = data;
+    switch (page->device) {
+        case MEM_DEVICE_PPU:
+            ppu = (ContextPPU *)page->ctx;
+            PPUSelect (mm, ppu, addr, 0);
+            ppu->pad[PPU_D] = data;
+            break;
+        case MEM_DEVICE_IO:
+            if (page->ctx) NESWriteIO ((ContextNES *)page->ctx, addr, data);
+            break;
+        case MEM_DEVICE_CART:
+            CartWrite ((Cartridge *)page->ctx, addr, data);
+            break;
+        case MEM_DEVICE_HANDLER:
+            if (page->wr) page->wr (page->ctx, addr, data);
+            break;
+    }
+}
+
+void MemRelease (MemoryMap *mm)
+{
+    if (mm->dbe) {
+        ((ContextPPU *)mm->dbe)->pad[PPU_nDBE] = 1;
+        mm->dbe = NULL;
+    }
+}
+
+void MemMapNES (MemoryMap *mm, unsigned char *ram, void *ppu, void *io)
+{
+    MemInit (mm);
+    MemMapHost (mm, 0x00, 0x1f, ram, 0x800, 1);
+    MemMapDevice (mm, 0x20, 0x3f, MEM_DEVICE_PPU, ppu);
+    MemMapDevice (mm, 0x40, 0x40, MEM_DEVICE_IO, io);
+}
+
+int VMemBus (VideoMap *vm, void *ppu)
+{
+    ContextPPU *p = (ContextPPU *)ppu;
+
+    if ( p->pad[PPU_ALE] ) {
+        vm->addr = (unsigned short)(p->pad[PPU_AD] & 0x3fff);
+        return 1;
+    }
+    if ( !p->pad[PPU_nRD] ) p->pad[PPU_AD] = VMEM_READ (vm, vm->addr);
+    else if ( !p->pad[PPU_nWR] ) VMEM_WRITE (vm, vm->addr, p->pad[PPU_AD]);
+    return 0;
+}
@@ -0,0 +1,90 @@
+// CPU address space as table of 256 pages, 256 bytes each.
+// Page is either direct host memory (RAM/ROM, served without any call) or device.
+// Known devices are dispatched by switch, MEM_DEVICE_HANDLER pages call function pointers.
+#pragma once
+
+#define MEM_PAGES       256
+#define MEM_PAGE_SIZE   256
+#define MEM_PAGE(addr)  (((addr) >> 8) & 0xff)
+
+// Devices.
+enum {
+    MEM_DEVICE_OPEN,        // nothing connected, reads return last bus value
+    MEM_DEVICE_PPU,         // PPU registers $2000-$3FFF, ctx: ContextPPU
+    MEM_DEVICE_IO,          // 2A03 I/O space $4000-$401F, ctx: ContextNES (sprite DMA, controllers; APU registers are internal)
+    MEM_DEVICE_CART,        // cartridge registers (writes to PRG ROM), ctx: Cartridge
+    MEM_DEVICE_HANDLER,     // read/write function pointers
+};
+
+typedef struct MemoryPage
+{
+    unsigned char   *read;      // host memory for reads (NULL: device)
+    unsigned char   *write;     // host memory for writes (NULL: device). Writes to ROM go to device too.
+    int     device;             // MEM_DEVICE_xxx
+    void    *ctx;               // device context
+    unsigned char   (*rd) (void *ctx, unsigned short addr, unsigned char bus);
+    void    (*wr) (void *ctx, unsigned short addr, unsigned char data);
+} MemoryPage;
+
+typedef struct MemoryMap
+{
+    MemoryPage  page[MEM_PAGES];
+    unsigned char   bus;        // last value on data bus (open bus)
+    void    *dbe;               // PPU with /DBE asserted by last access
+} MemoryMap;
+
+// Fast path: one indexed load for host pages.
+#define MEM_READ(mm,addr)   ( (mm)->page[MEM_PAGE(addr)].read ? \
+                              ((mm)->bus = (mm)->page[MEM_PAGE(addr)].read[(addr) & 0xff]) : \
+                              MemReadDevice ((mm), (unsigned short)(addr)) )
+#define MEM_WRITE(mm,addr,data) { if ( (mm)->page[MEM_PAGE(addr)].write ) \
+                                    (mm)->page[MEM_PAGE(addr)].write[(addr) & 0xff] = (mm)->bus = (unsigned char)(data); \
+                                  else MemWriteDevice ((mm), (unsigned short)(addr), (unsigned char)(data)); }
+
+void MemInit (MemoryMap *mm);
+
+// Map host memory. Size is multiple of page size, it is mirrored over [first, last] pages.
+// Read-only memory (ROM) is mapped with write = 0, writes then go to page device, so map device first.
+void MemMapHost (MemoryMap *mm, int first, int last, unsigned char *mem, unsigned long size, int write);
+
+// Map device to pages [first, last].
+void MemMapDevice (MemoryMap *mm, int first, int last, int device, void *ctx);
+void MemMapHandler (MemoryMap *mm, int first, int last, void *ctx,
+    unsigned char (*rd) (void *ctx, unsigned short addr, unsigned char bus),
+    void (*wr) (void *ctx, unsigned short addr, unsigned char data) );
+
+// Slow path (devices).
+unsigned char MemReadDevice (MemoryMap *mm, unsigned short addr);
+void MemWriteDevice (MemoryMap *mm, unsigned short addr, unsigned char data);
+
+// End of PHI2: release /DBE of PPU selected by last access.
+void MemRelease (MemoryMap *mm);
+
+// ------------------------------------------------------------------------
+// PPU address space $0000-$3FFF as 16 pages of 1 KB: pattern tables (CHR), nametables and their mirror.
+// Palette is inside PPU. Pages are set by cartridge (CHR banks, nametable mirroring).
+
+#define VMEM_PAGES      16
+#define VMEM_PAGE_SIZE  0x400
+#define VMEM_PAGE(addr) (((addr) >> 10) & 15)
+
+typedef struct VideoMap
+{
+    unsigned char   *read[VMEM_PAGES];
+    unsigned char   *write[VMEM_PAGES];     // NULL: read-only (CHR ROM)
+    unsigned short  addr;                   // address latched on PPU ALE (AD0-7 by external latch, PA8-13)
+} VideoMap;
+
+#define VMEM_READ(vm,addr)  ( (vm)->read[VMEM_PAGE(addr)][(addr) & 0x3ff] )
+#define VMEM_WRITE(vm,addr,data) { if ( (vm)->write[VMEM_PAGE(addr)] ) (vm)->write[VMEM_PAGE(addr)][(addr) & 0x3ff] = (unsigned char)(data); }
+
+// Video bus after PPU edge (ppu: ContextPPU): address latch follows AD on ALE, memory drives AD on /RD,
+// takes AD on /WR.
+// Returns 1 when address was latched.
+int VMemBus (VideoMap *vm, void *ppu);
+
+// ------------------------------------------------------------------------
+
+// Standard NES CPU map: 2 KB RAM mirrored to $0000-$1FFF, PPU mirrored to $2000-$3FFF, I/O at $4000-$40FF.
+// Cartridge space $4100-$FFFF is left open.
+void MemMapNES (MemoryMap *mm, unsigned char *ram, void *ppu, void *io);
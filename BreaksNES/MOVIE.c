@@ -0,0 +1,185 @@
+// Controller movies.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MOVIE.h"
+
+unsigned long MovieHash (const unsigned char *state, unsigned long size)
+{
+    unsigned long h = 2166136261u;
+
+    while (size--) h = ((h ^ *state++) * 16777619u) & 0xffffffff;
+    return h;
+}
+
+// Input callback is kept.
+static void Clear (Movie *mv)
+{
+    MovieInput input = mv->input;
+    void *opaque = mv->opaque;
+
+    memset (mv, 0, sizeof(Movie));
+    mv->input = input;
+    mv->opaque = opaque;
+    mv->desync = -1;
+}
+
+// Input and one frame of emulation, returns hash of state after it.
+static unsigned long RunFrame (Movie *mv, const unsigned char pad[2])
+{
+    ContextNES *nes = mv->nes;
+
+    if (mv->input) mv->input (mv->opaque, nes, pad);
+    NESRun (nes, nes->clk + NES_FRAME);
+    NESStateWrite (nes, mv->tmp);
+    return MovieHash (mv->tmp, mv->state_size);
+}
+
+// ------------------------------------------------------------------------
+// Recording
+
+int MovieRecord (Movie *mv, ContextNES *nes, unsigned long keyframe)
+{
+    Clear (mv);
+    mv->nes = nes;
+    mv->recording = 1;
+    mv->keyframe = keyframe > 0 ? keyframe : 1;
+    mv->state_size = NESStateSize (nes);
+    mv->tmp = (unsigned char *)malloc (mv->state_size);
+    return mv->tmp != NULL;
+}
+
+int MovieRecordFrame (Movie *mv, const unsigned char pad[2])
+{
+    MovieFrame *f;
+    void *p;
+
+    if ( !mv->recording ) return 0;
+
+    if ( mv->frames == mv->frames_max ) {
+        mv->frames_max = mv->frames_max ? mv->frames_max * 2 : 1024;
+        p = realloc (mv->frame, mv->frames_max * sizeof(MovieFrame));
+        if (p == NULL) return 0;
+        mv->frame = (MovieFrame *)p;
+    }
+
+    if ( mv->frames % mv->keyframe == 0 ) {
+        if ( mv->key_count == mv->key_max ) {
+            mv->key_max = mv->key_max ? mv->key_max * 2 : 16;
+            p = realloc (mv->key_buf, mv->key_max * mv->state_size);
+            if (p == NULL) return 0;
+            mv->key_buf = (unsigned char *)p;
+            mv->keys = mv->key_buf;
+        }
+        NESStateWrite (mv->nes, mv->key_buf + mv->key_count * mv->state_size);
+        mv->key_count++;
+    }
+
+    f = &mv->frame[mv->frames];
+    memset (f, 0, sizeof(MovieFrame));
+    f->pad[0] = pad[0];
+    f->pad[1] = pad[1];
+    f->hash = RunFrame (mv, pad);
+    mv->frames++;
+    mv->pos = mv->frames;
+    return 1;
+}
+
+int MovieSave (Movie *mv, const char *path)
+{
+    MovieHeader hdr;
+    FILE *f;
+    int ok;
+
+    memset (&hdr, 0, sizeof(hdr));
+    memcpy (hdr.magic, MOVIE_MAGIC, 4);
+    hdr.version = MOVIE_VERSION;
+    hdr.frames = mv->frames;
+    hdr.keyframe = mv->keyframe;
+    hdr.keys = mv->key_count;
+    hdr.state_size = mv->state_size;
+    hdr.frame_ticks = NES_FRAME;
+
+    f = fopen (path, "wb");
+    if (f == NULL) return 0;
+    ok = fwrite (&hdr, sizeof(hdr), 1, f) == 1;
+    if (mv->frames) ok = ok && fwrite (mv->frame, sizeof(MovieFrame), mv->frames, f) == (size_t)mv->frames;
+    if (mv->key_count) ok = ok && fwrite (mv->keys, mv->state_size, mv->key_count, f) == (size_t)mv->key_count;
+    if (fclose (f)) ok = 0;
+    return ok;
+}
+
+// ------------------------------------------------------------------------
+// Replay
+
+int MoviePlay (Movie *mv, ContextNES *nes, const char *path)
+{
+    MovieHeader hdr;
+    unsigned long size;
+
+    Clear (mv);
+    if ( !ImageOpen (&mv->image, path) ) return 0;
+
+    if ( mv->image.size < sizeof(hdr) ) goto bad;
+    memcpy (&hdr, mv->image.data, sizeof(hdr));
+    if ( memcmp (hdr.magic, MOVIE_MAGIC, 4) || hdr.version != MOVIE_VERSION ) goto bad;
+    if ( hdr.state_size != NESStateSize (nes) || hdr.frame_ticks != NES_FRAME || hdr.keyframe == 0 ) goto bad;
+    if ( hdr.keys == 0 || hdr.keys != (hdr.frames + hdr.keyframe - 1) / hdr.keyframe ) goto bad;
+    size = sizeof(hdr) + hdr.frames * sizeof(MovieFrame) + hdr.keys * hdr.state_size;
+    if ( mv->image.size != size ) goto bad;
+
+    mv->nes = nes;
+    mv->frames = mv->frames_max = hdr.frames;
+    mv->keyframe = hdr.keyframe;
+    mv->key_count = hdr.keys;
+    mv->state_size = hdr.state_size;
+    mv->frame = (MovieFrame *)malloc (mv->frames * sizeof(MovieFrame));
+    mv->tmp = (unsigned char *)malloc (mv->state_size);
+    if ( mv->frame == NULL || mv->tmp == NULL ) goto bad;
+    memcpy (mv->frame, mv->image.data + sizeof(hdr), mv->frames * sizeof(MovieFrame));
+    mv->keys = mv->image.data + sizeof(hdr) + mv->frames * sizeof(MovieFrame);
+
+    if ( !NESStateRead (nes, mv->keys, mv->state_size) ) goto bad;     // other cartridge
+    return 1;
+
+bad:
+    MovieClose (mv);
+    return 0;
+}
+
+int MoviePlayFrame (Movie *mv)
+{
+    MovieFrame *f;
+
+    if ( mv->recording || mv->pos >= mv->frames ) return 0;
+
+    f = &mv->frame[mv->pos];
+    if ( RunFrame (mv, f->pad) != f->hash && mv->desync < 0 ) mv->desync = mv->pos;
+    mv->pos++;
+    return 1;
+}
+
+int MovieSeek (Movie *mv, long frame)
+{
+    long key;
+
+    if ( mv->recording || frame < 0 || frame > mv->frames ) return 0;
+
+    key = frame / mv->keyframe;
+    if ( key >= mv->key_count ) key = mv->key_count - 1;
+    if ( !NESStateRead (mv->nes, mv->keys + key * mv->state_size, mv->state_size) ) return 0;
+    mv->pos = key * mv->keyframe;
+    if ( mv->desync >= mv->pos ) mv->desync = -1;       // checked again on the way
+
+    while ( mv->pos < frame ) MoviePlayFrame (mv);
+    return 1;
+}
+
+void MovieClose (Movie *mv)
+{
+    free (mv->frame);
+    free (mv->key_buf);
+    free (mv->tmp);
+    if (mv->image.data) ImageClose (&mv->image);
+    Clear (mv);
+}
@@ -0,0 +1,77 @@
+// Controller movies: per-frame input with embedded savestate keyframes.
+//
+// Movie frame is NES_FRAME master ticks, starting from state saved when recording began (key 0).
+// Every K-th frame start is saved as keyframe, so seeking loads nearest keyframe and fast-forwards
+// at most K-1 frames. Every frame also keeps hash of whole state after it, replay compares it to detect desync.
+//
+// File: MovieHeader, frames[], keyframe states (NESStateSize bytes each). Native byte order, like savestates.
+// Played movie is mapped, keyframes are used from the mapping.
+#pragma once
+
+#include "STATE.h"
+
+#define MOVIE_MAGIC     "BMOV"
+#define MOVIE_VERSION   1
+
+typedef struct MovieHeader
+{
+    char    magic[4];
+    unsigned long   version;
+    unsigned long   frames;
+    unsigned long   keyframe;       // K
+    unsigned long   keys;
+    unsigned long   state_size;
+    unsigned long   frame_ticks;
+} MovieHeader;
+
+typedef struct MovieFrame
+{
+    unsigned char   pad[2];         // buttons of controller 1 and 2 (bit 0: A ... bit 7: Right)
+    unsigned char   reserved[2];
+    unsigned long   hash;           // state hash after frame
+} MovieFrame;
+
+// Puts frame input on controller ports.
+typedef void (*MovieInput) (void *opaque, ContextNES *nes, const unsigned char pad[2]);
+
+typedef struct Movie
+{
+    ContextNES  *nes;
+    MovieInput  input;              // optional, set by caller (Movie zeroed first), kept by Record / Play / Close
+    void    *opaque;
+
+    int     recording;
+    unsigned long   keyframe, state_size;
+    MovieFrame  *frame;
+    long    frames, frames_max;
+    const unsigned char *keys;      // keyframe states
+    unsigned char   *key_buf;       // recording: growing key storage
+    long    key_count, key_max;
+    unsigned char   *tmp;           // state of current frame, for hash
+
+    Image   image;                  // played movie
+    long    pos;                    // next frame
+    long    desync;                 // first frame with wrong hash, -1: in sync
+} Movie;
+
+// Start recording from current state. keyframe: K (>= 1).
+int MovieRecord (Movie *mv, ContextNES *nes, unsigned long keyframe);
+
+// Apply input, run one frame and store it.
+int MovieRecordFrame (Movie *mv, const unsigned char pad[2]);
+
+int MovieSave (Movie *mv, const char *path);
+
+// Open movie for replay and load its first frame state. Cartridge must be loaded already.
+int MoviePlay (Movie *mv, ContextNES *nes, const char *path);
+
+// Run next frame with its recorded input and check hash. Returns 0 at end of movie.
+int MoviePlayFrame (Movie *mv);
+
+// Go to start of frame (keyframe + fast-forward). Returns 0 if out of movie.
+int MovieSeek (Movie *mv, long frame);
+
+void MovieClose (Movie *mv);
+
+// FNV-1a hash of serialized state.
+unsigned long MovieHash (const unsigned char *state, unsigned long size);
@@ -0,0 +1,323 @@
+// NTSC decoder.
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "NTSC.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NTSC_AVX2
+#include <immintrin.h>
+#endif
+
+#define QUADS       (NTSC_SAMPLES / 4)
+#define BURST_H     310         // burst dots measured (H 310-321, 96 samples, whole subcarrier periods)
+#define BURST_DOTS  12
+#define SATURATION  1.0f
+
+// YUV -> RGB (0...255), per output component B, G, R.
+static const float yuv_y[3] = { 255.0f, 255.0f, 255.0f };
+static const float yuv_u[3] = { 2.032f * 255.0f, -0.395f * 255.0f, 0.0f };
+static const float yuv_v[3] = { 0.0f, -0.581f * 255.0f, 1.140f * 255.0f };
+
+// Filter weights over quads (4 samples) around pixel: luma 3 quads, chroma 6 (half weight at ends).
+static const float wy[7] = { 0, 0, 1.0f / 12, 1.0f / 12, 1.0f / 12, 0, 0 };
+static const float wc[7] = { 0.5f / 24, 1.0f / 24, 1.0f / 24, 1.0f / 24, 1.0f / 24, 1.0f / 24, 0.5f / 24 };
+
+static float sub_cos[12], sub_sin[12];      // subcarrier at chroma phase
+
+// ------------------------------------------------------------------------
+// Line decoders
+
+static unsigned int Pack (float y, float u, float v)
+{
+    unsigned int pix = 0;
+    float c;
+    int n;
+
+    for (n=2; n>=0; n--) {
+        c = y * yuv_y[n] + u * yuv_u[n] + v * yuv_v[n];
+        c = c < 0 ? 0 : (c > 255 ? 255 : c);
+        pix = (pix << 8) | (unsigned int)(c + 0.5f);
+    }
+    return pix;
+}
+
+static void RowScalar (const NTSCLine *line, unsigned int *out)
+{
+    float quad[QUADS][3], y, u, v, s;
+    int q, i, k, x;
+
+    for (q=0, i=0; q<QUADS; q++) {
+        y = u = v = 0;
+        for (k=0; k<4; k++, i++) {
+            s = line->s[i];
+            y += s;
+            u += s * line->u[i % 24];
+            v += s * line->v[i % 24];
+        }
+        quad[q][0] = y;
+        quad[q][1] = u;
+        quad[q][2] = v;
+    }
+
+    for (x=0; x<NTSC_WIDTH; x++) {
+        y = u = v = 0;
+        for (k=0; k<7; k++) {
+            q = x + NTSC_TAIL / 4 - 3 + k;
+            y += quad[q][0] * wy[k];
+            u += quad[q][1] * wc[k];
+            v += quad[q][2] * wc[k];
+        }
+        out[x] = Pack (y, u, v);
+    }
+}
+
+#ifdef NTSC_AVX2
+// Quads come out of three horizontal adds as (Y, U, V, V), two per vector; pixels are done two per vector too.
+__attribute__((target("avx2,fma")))
+static void RowAVX2 (const NTSCLine *line, unsigned int *out)
+{
+    float quad[QUADS * 4 + 8];
+    __m256 ref_u[3], ref_v[3], w[7], cy, cu, cv, lo, hi, s, su, sv, acc, rgb;
+    __m256i pix;
+    int i, k, x;
+
+    for (k=0; k<3; k++) {
+        ref_u[k] = _mm256_loadu_ps (&line->u[k * 8]);
+        ref_v[k] = _mm256_loadu_ps (&line->v[k * 8]);
+    }
+    for (i=0; i<NTSC_SAMPLES; i+=24) {
+        for (k=0; k<3; k++) {
+            s = _mm256_loadu_ps (&line->s[i + k * 8]);
+            su = _mm256_mul_ps (s, ref_u[k]);
+            sv = _mm256_mul_ps (s, ref_v[k]);
+            acc = _mm256_hadd_ps (_mm256_hadd_ps (s, su), _mm256_hadd_ps (sv, sv));
+            _mm256_storeu_ps (&quad[i + k * 8], acc);
+        }
+    }
+
+    for (k=0; k<7; k++) w[k] = _mm256_setr_ps (wy[k], wc[k], wc[k], 0, wy[k], wc[k], wc[k], 0);
+    cy = _mm256_setr_ps (yuv_y[0], yuv_y[1], yuv_y[2], 0, yuv_y[0], yuv_y[1], yuv_y[2], 0);
+    cu = _mm256_setr_ps (yuv_u[0], yuv_u[1], yuv_u[2], 0, yuv_u[0], yuv_u[1], yuv_u[2], 0);
+    cv = _mm256_setr_ps (yuv_v[0], yuv_v[1], yuv_v[2], 0, yuv_v[0], yuv_v[1], yuv_v[2], 0);
+    lo = _mm256_setzero_ps ();
+    hi = _mm256_set1_ps (255.0f);
+
+    for (x=0; x<NTSC_WIDTH; x+=2) {
+        acc = _mm256_setzero_ps ();
+        for (k=0; k<7; k++) {
+            acc = _mm256_fmadd_ps (_mm256_loadu_ps (&quad[(x + NTSC_TAIL / 4 - 3 + k) * 4]), w[k], acc);
+        }
+        rgb = _mm256_mul_ps (_mm256_permute_ps (acc, 0x00), cy);
+        rgb = _mm256_fmadd_ps (_mm256_permute_ps (acc, 0x55), cu, rgb);
+        rgb = _mm256_fmadd_ps (_mm256_permute_ps (acc, 0xaa), cv, rgb);
+        rgb = _mm256_min_ps (_mm256_max_ps (rgb, lo), hi);
+        pix = _mm256_cvtps_epi32 (rgb);
+        pix = _mm256_packus_epi32 (pix, pix);
+        pix = _mm256_packus_epi16 (pix, pix);
+        out[x] = (unsigned int)_mm256_cvtsi256_si32 (pix);
+        out[x + 1] = (unsigned int)_mm_cvtsi128_si32 (_mm256_extracti128_si256 (pix, 1));
+    }
+}
+#endif
+
+// ------------------------------------------------------------------------
+// Decode job
+
+static void Band (NTSC *tv, int band)
+{
+    NTSCLine *lines = tv->lines[tv->src];
+    int v;
+
+    for (v=band*NTSC_BAND; v<(band+1)*NTSC_BAND; v++) tv->row (&lines[v], tv->rgb[tv->dst][v]);
+    if ( ATOMIC_ADD (&tv->done, 1) == NTSC_BANDS - 1 ) {
+        ATOMIC_STORE (&tv->front, tv->dst);
+        ATOMIC_ADD (&tv->frames, 1);
+    }
+}
+
+static int Take (NTSC *tv)
+{
+    long n;
+
+    if ( ATOMIC_LOAD (&tv->next) >= NTSC_BANDS ) return -1;
+    n = ATOMIC_ADD (&tv->next, 1);
+    return n < NTSC_BANDS ? (int)n : -1;
+}
+
+// Finish job in progress, taking bands nobody took yet.
+static void Wait (NTSC *tv)
+{
+    int n;
+
+    while ( (n = Take (tv)) >= 0 ) Band (tv, n);
+    while ( ATOMIC_LOAD (&tv->done) < NTSC_BANDS ) CPU_PAUSE ();
+}
+
+static void Worker (void *arg)
+{
+    NTSC *tv = (NTSC *)arg;
+    int n, idle = 0;
+
+    while ( !ATOMIC_LOAD (&tv->quit) ) {
+        if ( (n = Take (tv)) < 0 ) {
+            if ( ++idle < 64 ) ThreadYield ();
+            else ThreadSleep (1);
+            continue;
+        }
+        idle = 0;
+        Band (tv, n);
+    }
+}
+
+static void Publish (NTSC *tv)
+{
+    Wait (tv);
+    tv->src = tv->back;
+    tv->back ^= 1;
+    tv->dst = (int)tv->front ^ 1;
+    ATOMIC_STORE (&tv->done, 0);
+    ATOMIC_STORE (&tv->next, 0);
+    if ( tv->workers == 0 ) Wait (tv);
+}
+
+// ------------------------------------------------------------------------
+// Lines
+
+// Burst of line is at its end, so it sets phase of next line.
+static void Burst (NTSC *tv, const float *samples, int phase)
+{
+    float i = 0, q = 0, mag;
+    int n, p;
+
+    for (n=0; n<BURST_DOTS*8; n++) {
+        p = (phase + BURST_H * 8 + n) % 12;
+        i += samples[BURST_H * 8 + n] * sub_cos[p];
+        q += samples[BURST_H * 8 + n] * sub_sin[p];
+    }
+    mag = (float)sqrt (i * i + q * q);
+    if ( mag < 1.0f ) tv->burst_u = tv->burst_v = 0;
+    else {
+        tv->burst_u = i / mag;
+        tv->burst_v = q / mag;
+    }
+}
+
+// Demodulation references for samples from chroma phase. Burst is at 180 degrees (-U); references carry
+// 2x of product mean (amplitude) and saturation.
+static void Refs (float burst_u, float burst_v, int phase, float *u, float *v, int count)
+{
+    int n, p;
+
+    for (n=0; n<count; n++) {
+        p = (phase + n) % 12;
+        u[n] = -2 * SATURATION * (sub_cos[p] * burst_u + sub_sin[p] * burst_v);
+        v[n] = 2 * SATURATION * (sub_sin[p] * burst_u - sub_cos[p] * burst_v);
+    }
+}
+
+static void LineDone (void *opaque, int v, const float *samples, int phase)
+{
+    NTSC *tv = (NTSC *)opaque;
+    NTSCLine *line;
+
+    if ( v < NTSC_HEIGHT ) {
+        line = &tv->lines[tv->back][v];
+        Refs (tv->burst_u, tv->burst_v, (phase - NTSC_TAIL % 12 + 12) % 12, line->u, line->v, 24);
+        memcpy (line->s, tv->tail, sizeof(tv->tail));
+        memcpy (line->s + NTSC_TAIL, samples, (NTSC_SAMPLES - NTSC_TAIL) * sizeof(float));
+    }
+    memcpy (tv->tail, samples + PPU_LINE_SAMPLES - NTSC_TAIL, sizeof(tv->tail));
+    Burst (tv, samples, phase);
+    if ( v == NTSC_HEIGHT - 1 ) Publish (tv);
+}
+
+// ------------------------------------------------------------------------
+// API
+
+static void Subcarrier (void)
+{
+    int n;
+
+    for (n=0; n<12; n++) {
+        sub_cos[n] = (float)cos (n * 3.14159265358979 / 6);
+        sub_sin[n] = (float)sin (n * 3.14159265358979 / 6);
+    }
+}
+
+int NTSCInit (NTSC *tv, ContextPPU *ppu, int threads)
+{
+    int n;
+
+    memset (tv, 0, sizeof(NTSC));
+    Subcarrier ();
+    tv->lines[0] = (NTSCLine *)calloc (2 * NTSC_HEIGHT, sizeof(NTSCLine));
+    tv->rgb = (unsigned int (*)[NTSC_HEIGHT][NTSC_WIDTH])calloc (2, sizeof(*tv->rgb));
+    if ( tv->lines[0] == NULL || tv->rgb == NULL ) {
+        NTSCFree (tv);
+        return 0;
+    }
+    tv->lines[1] = tv->lines[0] + NTSC_HEIGHT;
+    tv->next = tv->done = NTSC_BANDS;
+
+    tv->row = RowScalar;
+#ifdef NTSC_AVX2
+    if ( __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma") ) tv->row = RowAVX2;
+#endif
+
+    if ( threads > NTSC_WORKERS ) threads = NTSC_WORKERS;
+    for (n=0; n<threads; n++) {
+        tv->worker[tv->workers] = ThreadCreate (Worker, tv);
+        if ( tv->worker[tv->workers] ) tv->workers++;
+    }
+
+    tv->ppu = ppu;
+    PPUSetComposite (ppu, &tv->cv, LineDone, tv);
+    return 1;
+}
+
+void NTSCFree (NTSC *tv)
+{
+    int n;
+
+    if ( tv->ppu ) PPUSetComposite (tv->ppu, NULL, NULL, NULL);
+    if ( tv->lines[0] ) Wait (tv);
+    ATOMIC_STORE (&tv->quit, 1);
+    for (n=0; n<tv->workers; n++) ThreadJoin (tv->worker[n]);
+    free (tv->lines[0]);
+    free (tv->rgb);
+    memset (tv, 0, sizeof(NTSC));
+}
+
+const unsigned int * NTSCFrame (NTSC *tv, long *frames)
+{
+    if (frames) *frames = ATOMIC_LOAD (&tv->frames);
+    return &tv->rgb[ATOMIC_LOAD (&tv->front)][0][0];
+}
+
+// Same filters over flat line: window sums of one subcarrier period.
+void NTSCPalette (unsigned int palette[512])
+{
+    const float *wave = PPUWaveform (-1);
+    float i = 0, q = 0, mag, u[12], v[12], y, cu, cv;
+    int pix, p;
+
+    Subcarrier ();
+    for (p=0; p<12; p++) {
+        i += wave[p] * sub_cos[p];
+        q += wave[p] * sub_sin[p];
+    }
+    mag = (float)sqrt (i * i + q * q);
+    Refs (i / mag, q / mag, 0, u, v, 12);
+
+    for (pix=0; pix<512; pix++) {
+        wave = PPUWaveform (pix);
+        y = cu = cv = 0;
+        for (p=0; p<12; p++) {
+            y += wave[p];
+            cu += wave[p] * u[p];
+            cv += wave[p] * v[p];
+        }
+        palette[pix] = Pack (y / 12, cu / 12, cv / 12);
+    }
+}
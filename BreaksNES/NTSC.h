@@ -0,0 +1,61 @@
+// NTSC decoder: RGB picture from PPU composite samples, as TV would show it (dot crawl, color fringes).
+//
+// Each visible line is demodulated at phase of color burst of line before it: luma is 12-sample box
+// (one subcarrier period, takes chroma out), I/Q products are 24-sample box. Output has two pixels per dot
+// (4 samples each). Line without burst is black and white (color killer).
+// Lines are copied while PPU draws; finished frame is decoded in bands of lines by worker threads, while
+// board runs next frame. Next finished frame waits for decode (caller helps), so decoder never falls behind.
+// Decoder is AVX2 when CPU has it, plain C otherwise.
+#pragma once
+
+#include "THREAD.h"
+#include "../BreaksPPU/PPU.h"
+
+#define NTSC_WIDTH      (PPU_WIDTH * 2)
+#define NTSC_HEIGHT     PPU_HEIGHT
+#define NTSC_TAIL       16          // samples of previous line kept before H = 0 (filter taps)
+#define NTSC_SAMPLES    2088        // samples of line row: tail + H 0...258, multiple of 24
+#define NTSC_BAND       16          // lines per band
+#define NTSC_BANDS      (NTSC_HEIGHT / NTSC_BAND)
+#define NTSC_WORKERS    8
+
+// Line row: samples and demodulation references (U, V) for 2 subcarrier periods from first sample.
+typedef struct NTSCLine
+{
+    float   u[24], v[24];
+    float   s[NTSC_SAMPLES];
+} NTSCLine;
+
+typedef struct NTSC
+{
+    ContextPPU  *ppu;
+    PPUComposite    cv;
+    void    (*row)(const NTSCLine *line, unsigned int *out);
+
+    // Lines in progress (back) and lines being decoded (src).
+    NTSCLine    *lines[2];
+    int     back, src, dst;
+    float   tail[NTSC_TAIL];
+    float   burst_u, burst_v;       // burst phase of last line (unit vector), 0: no burst
+
+    // Decode job: bands taken by workers and caller.
+    volatile long   next, done;
+    volatile long   quit;
+    Thread  worker[NTSC_WORKERS];
+    int     workers;
+
+    // Pixel: 0x00RRGGBB. Double buffered like PPUFramebuffer.
+    unsigned int    (*rgb)[NTSC_HEIGHT][NTSC_WIDTH];
+    volatile long   front, frames;
+} NTSC;
+
+// Attach decoder to PPU composite output. threads: decode workers (0: decode on emulation thread).
+// Returns 0 if out of memory.
+int NTSCInit (NTSC *tv, ContextPPU *ppu, int threads);
+void NTSCFree (NTSC *tv);
+
+// Last decoded frame (NTSC_HEIGHT rows of NTSC_WIDTH pixels), frames decoded so far in *frames (may be NULL).
+const unsigned int * NTSCFrame (NTSC *tv, long *frames);
+
+// RGB (0x00RRGGBB) of flat field of each framebuffer pixel value (color + emphasis), as decoder shows it.
+void NTSCPalette (unsigned int palette[512]);
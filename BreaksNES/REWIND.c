@@ -0,0 +1,237 @@
+// In-memory rewind ring.
+#include <stdlib.h>
+#include <string.h>
+#include "REWIND.h"
+
+#define ENTRY(rw,n)     (&(rw)->entry[((rw)->first + (n)) % REWIND_ENTRIES])
+#define MAX_RUN         0xffff
+#define MIN_SKIP        4           // shorter zero runs stay inside literal (token header is 4 bytes)
+#define X(i)            (b ? a[i] ^ b[i] : a[i])
+
+// ------------------------------------------------------------------------
+// Coding. Record is list of tokens: u16 skip (unchanged bytes), u16 count, count XOR bytes.
+
+static unsigned long EncodeBound (unsigned long size)
+{
+    return size + 8 + (size / MAX_RUN + 1) * 4;
+}
+
+static void PutWord (unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+// XOR of a and b (b NULL: zero), coded to out. Returns record size.
+static unsigned long Encode (unsigned char *out, const unsigned char *a, const unsigned char *b, unsigned long size)
+{
+    unsigned long i = 0, o = 0, skip, start, z, n;
+
+    while ( i < size ) {
+        for (skip=0; i<size && skip<MAX_RUN && X(i) == 0; i++) skip++;
+
+        start = i;
+        while ( i < size && i - start < MAX_RUN ) {
+            if ( X(i) == 0 ) {
+                for (z=i; z<size && z-i<MIN_SKIP && X(z) == 0; z++) ;
+                if ( z - i == MIN_SKIP || z == size ) break;
+            }
+            i++;
+        }
+
+        PutWord (out + o, skip);
+        PutWord (out + o + 2, i - start);
+        o += 4;
+        for (n=start; n<i; n++) out[o++] = X(n);
+    }
+    return o;
+}
+
+// XOR record into dst.
+static void Apply (unsigned char *dst, const unsigned char *rec, unsigned long size)
+{
+    unsigned long p = 0, r = 0, count;
+
+    while ( r + 4 <= size ) {
+        p += rec[r] | (rec[r+1] << 8);
+        count = rec[r+2] | (rec[r+3] << 8);
+        r += 4;
+        while (count--) dst[p++] ^= rec[r++];
+    }
+}
+
+// ------------------------------------------------------------------------
+// Ring
+
+// Drop oldest keyframe and its deltas.
+static void EvictGroup (Rewind *rw)
+{
+    do {
+        rw->first = (rw->first + 1) % REWIND_ENTRIES;
+        rw->count--;
+    } while ( rw->count > 0 && !ENTRY(rw,0)->key );
+}
+
+static int Overlaps (RewindEntry *e, unsigned long pos, unsigned long size)
+{
+    return e->offset < pos + size && pos < e->offset + e->size;
+}
+
+static void Process (Rewind *rw, unsigned char *raw)
+{
+    unsigned long size, pos;
+    RewindEntry *e;
+    int key = rw->since_key == 0;
+
+    size = Encode (rw->tmp, raw, key ? NULL : rw->key_raw, rw->state_size);
+    if ( size > rw->ring_size ) {       // ring is too small even for one frame
+        rw->count = 0;
+        rw->since_key = 0;
+        return;
+    }
+
+    if ( rw->count == REWIND_ENTRIES ) EvictGroup (rw);
+    pos = rw->ring_head + size <= rw->ring_size ? rw->ring_head : 0;
+    while ( rw->count > 0 && Overlaps (ENTRY(rw,0), pos, size) ) EvictGroup (rw);
+
+    if ( rw->count == 0 && !key ) {     // own keyframe was evicted, start new group
+        key = 1;
+        size = Encode (rw->tmp, raw, NULL, rw->state_size);
+        pos = rw->ring_head + size <= rw->ring_size ? rw->ring_head : 0;
+    }
+
+    memcpy (rw->ring + pos, rw->tmp, size);
+    rw->ring_head = pos + size;
+    if ( rw->count == 0 ) rw->first = 0;
+    e = ENTRY(rw, rw->count);
+    e->offset = pos;
+    e->size = size;
+    e->key = key;
+    rw->count++;
+
+    if (key) {
+        memcpy (rw->key_raw, raw, rw->state_size);
+        rw->since_key = 0;
+    }
+    rw->since_key = (rw->since_key + 1) % rw->keyframe;
+}
+
+static void Worker (void *arg)
+{
+    Rewind *rw = (Rewind *)arg;
+    long tail = rw->tail;
+    int idle = 0;
+
+    while ( !ATOMIC_LOAD(&rw->quit) ) {
+        if ( tail == ATOMIC_LOAD(&rw->head) ) {
+            if ( ++idle < 64 ) ThreadYield ();
+            else ThreadSleep (1);
+            continue;
+        }
+        idle = 0;
+        Process (rw, rw->pending[tail % REWIND_PENDING]);
+        ATOMIC_STORE (&rw->tail, ++tail);
+    }
+}
+
+// Wait until worker has coded everything, after that ring belongs to caller.
+static void Flush (Rewind *rw)
+{
+    while ( ATOMIC_LOAD(&rw->tail) != rw->head ) ThreadYield ();
+}
+
+// ------------------------------------------------------------------------
+// API
+
+int RewindInit (Rewind *rw, ContextNES *nes, unsigned long megabytes, int keyframe)
+{
+    int n;
+
+    memset (rw, 0, sizeof(Rewind));
+    rw->nes = nes;
+    rw->state_size = NESStateSize (nes);
+    rw->keyframe = keyframe > 0 ? keyframe : 1;
+    rw->ring_size = megabytes << 20;
+
+    rw->ring = (unsigned char *)malloc (rw->ring_size);
+    rw->key_raw = (unsigned char *)malloc (rw->state_size);
+    rw->tmp = (unsigned char *)malloc (EncodeBound (rw->state_size));
+    for (n=0; n<REWIND_PENDING; n++) rw->pending[n] = (unsigned char *)malloc (rw->state_size);
+
+    for (n=0; n<REWIND_PENDING; n++) {
+        if ( rw->pending[n] == NULL ) rw->ring_size = 0;
+    }
+    if ( rw->ring == NULL || rw->key_raw == NULL || rw->tmp == NULL || rw->ring_size == 0 ) {
+        RewindFree (rw);
+        return 0;
+    }
+
+    rw->worker = ThreadCreate (Worker, rw);     // NULL: code on caller thread
+    return 1;
+}
+
+void RewindFree (Rewind *rw)
+{
+    int n;
+
+    if (rw->worker) {
+        ATOMIC_STORE (&rw->quit, 1);
+        ThreadJoin (rw->worker);
+        rw->worker = NULL;
+    }
+    free (rw->ring);
+    free (rw->key_raw);
+    free (rw->tmp);
+    for (n=0; n<REWIND_PENDING; n++) free (rw->pending[n]);
+    memset (rw, 0, sizeof(Rewind));
+}
+
+void RewindPush (Rewind *rw)
+{
+    long head = rw->head;
+    unsigned char *raw;
+
+    while ( head - ATOMIC_LOAD(&rw->tail) >= REWIND_PENDING ) ThreadYield ();
+
+    raw = rw->pending[head % REWIND_PENDING];
+    NESStateWrite (rw->nes, raw);
+    if ( rw->worker == NULL ) {
+        Process (rw, raw);
+        rw->tail = head + 1;
+    }
+    ATOMIC_STORE (&rw->head, head + 1);
+}
+
+long RewindFrames (Rewind *rw)
+{
+    Flush (rw);
+    return rw->count;
+}
+
+int RewindBack (Rewind *rw, long n)
+{
+    long idx, key;
+    RewindEntry *e, *k;
+    unsigned char *raw = rw->pending[0];        // free after flush
+
+    Flush (rw);
+    if ( n < 0 || n >= rw->count ) return 0;
+
+    idx = rw->count - 1 - n;
+    for (key=idx; key>0 && !ENTRY(rw,key)->key; key--) ;
+    e = ENTRY(rw, idx);
+    k = ENTRY(rw, key);
+
+    memset (rw->key_raw, 0, rw->state_size);
+    Apply (rw->key_raw, rw->ring + k->offset, k->size);
+    memcpy (raw, rw->key_raw, rw->state_size);
+    if ( idx != key ) Apply (raw, rw->ring + e->offset, e->size);
+
+    if ( !NESStateRead (rw->nes, raw, rw->state_size) ) return 0;
+
+    // Restored frame becomes newest, following pushes continue its group.
+    rw->count = idx + 1;
+    rw->ring_head = e->offset + e->size;
+    rw->since_key = (int)((idx - key + 1) % rw->keyframe);
+    return 1;
+}
@@ -0,0 +1,56 @@
+// In-memory rewind ring on top of savestates.
+//
+// Every K-th frame is keyframe, frames in between are stored as delta against their keyframe,
+// so restoring any frame decodes at most two records. Records are XOR against keyframe (or zero for
+// keyframe itself), then zero-run/literal coded. Gate-level contexts barely change between frames,
+// so deltas are small.
+// Capture only copies state to pending buffer; coding runs on background thread.
+// Memory: ring of given size + REWIND_PENDING + 3 raw states.
+#pragma once
+
+#include "THREAD.h"
+#include "STATE.h"
+
+#define REWIND_PENDING  4           // raw states waiting for compression
+#define REWIND_ENTRIES  65536       // max frames in ring
+
+typedef struct RewindEntry
+{
+    unsigned long   offset, size;   // record in ring
+    int     key;                    // 1: keyframe
+} RewindEntry;
+
+typedef struct Rewind
+{
+    ContextNES  *nes;
+    unsigned long   state_size;
+    int     keyframe;               // K
+
+    // Ring (owned by worker while pending queue is not empty).
+    unsigned char   *ring;
+    unsigned long   ring_size, ring_head;
+    RewindEntry     entry[REWIND_ENTRIES];
+    long    first, count;           // entries kept
+    int     since_key;              // frames since last keyframe
+    unsigned char   *key_raw;       // raw state of last keyframe
+    unsigned char   *tmp;           // XOR work buffer
+
+    // Pending raw states (producer: emulation thread, consumer: worker).
+    unsigned char   *pending[REWIND_PENDING];
+    volatile long   head, tail;
+    volatile long   quit;
+    Thread  worker;
+} Rewind;
+
+// size in megabytes, keyframe: K (>= 1). Returns 0 if out of memory.
+int RewindInit (Rewind *rw, ContextNES *nes, unsigned long megabytes, int keyframe);
+void RewindFree (Rewind *rw);
+
+// Capture current board state (once per frame).
+void RewindPush (Rewind *rw);
+
+// Number of frames that can be restored.
+long RewindFrames (Rewind *rw);
+
+// Restore state n frames back (0: last pushed). Newer frames are dropped. Returns 0 if not available.
+int RewindBack (Rewind *rw, long n);
@@ -0,0 +1,169 @@
+// Whole-system savestates.
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "STATE.h"
+
+// Sections stored as raw bytes of board context.
+static struct {
+    char    *id;
+    unsigned long   offset, size;
+} sections[] = {
+    { "CLK ", offsetof(ContextNES, clk), offsetof(ContextNES, apu) - offsetof(ContextNES, clk) },    // clk, next, cycles, divider
+    { "2A03", offsetof(ContextNES, apu), sizeof(ContextAPU) },
+    { "PPU ", offsetof(ContextNES, ppu), offsetof(ContextPPU, fb) },      // framebuffer pointer is not state
+    { "RAM ", offsetof(ContextNES, ram), sizeof(((ContextNES *)0)->ram) },
+    { "VRAM", offsetof(ContextNES, ciram), sizeof(((ContextNES *)0)->ciram) },
+    { "MAPR", offsetof(ContextNES, cart.state), sizeof(CartridgeState) },
+    { "JOYP", offsetof(ContextNES, pads.state), sizeof(JoypadState) },
+    { "DMA ", offsetof(ContextNES, dma), sizeof(SpriteDMA) },
+};
+#define RAW_SECTIONS    (sizeof(sections) / sizeof(sections[0]))
+
+// Other sections.
+typedef struct StateCart        // cartridge identity, state of other cartridge is rejected
+{
+    unsigned long   mapper, prg_size, chr_size;
+} StateCart;
+
+typedef struct StateBus
+{
+    unsigned char   bus;        // open bus value
+    unsigned char   dbe;        // PPU /DBE held by last access
+    unsigned short  vaddr;      // PPU address latch
+} StateBus;
+
+#define SECTIONS    (RAW_SECTIONS + 2)
+
+unsigned long NESStateSize (ContextNES *nes)
+{
+    unsigned long size = sizeof(NESStateHeader) + SECTIONS * sizeof(NESStateSection);
+    unsigned n;
+
+    (void)nes;      // size depends on build only
+    for (n=0; n<RAW_SECTIONS; n++) size += sections[n].size;
+    return size + sizeof(StateCart) + sizeof(StateBus);
+}
+
+static unsigned char * PutSection (unsigned char *p, char *id, void *data, unsigned long size)
+{
+    NESStateSection sec;
+
+    memset (&sec, 0, sizeof(sec));      // padding too, equal states give equal bytes
+    memcpy (sec.id, id, 4);
+    sec.size = size;
+    memcpy (p, &sec, sizeof(sec));
+    memcpy (p + sizeof(sec), data, size);
+    return p + sizeof(sec) + size;
+}
+
+unsigned long NESStateWrite (ContextNES *nes, unsigned char *buf)
+{
+    NESStateHeader hdr;
+    StateCart cart;
+    StateBus bus;
+    unsigned char *p = buf + sizeof(hdr);
+    unsigned n;
+
+    memset (&hdr, 0, sizeof(hdr));
+    memcpy (hdr.magic, NES_STATE_MAGIC, 4);
+    hdr.version = NES_STATE_VERSION;
+    hdr.sections = SECTIONS;
+    hdr.size = NESStateSize (nes);
+    memcpy (buf, &hdr, sizeof(hdr));
+
+    memset (&cart, 0, sizeof(cart));
+    cart.mapper = nes->cart.mapper;
+    cart.prg_size = nes->cart.prg_size;
+    cart.chr_size = nes->cart.chr_size;
+    p = PutSection (p, "CART", &cart, sizeof(cart));
+
+    for (n=0; n<RAW_SECTIONS; n++) {
+        p = PutSection (p, sections[n].id, (unsigned char *)nes + sections[n].offset, sections[n].size);
+    }
+
+    memset (&bus, 0, sizeof(bus));
+    bus.bus = nes->mem.bus;
+    bus.dbe = nes->mem.dbe != NULL;
+    bus.vaddr = nes->vmem.addr;
+    p = PutSection (p, "BUS ", &bus, sizeof(bus));
+
+    return p - buf;
+}
+
+// Returns section data or NULL if next section is not expected one.
+static const unsigned char * GetSection (const unsigned char **p, const unsigned char *end, char *id, unsigned long size)
+{
+    NESStateSection sec;
+    const unsigned char *data;
+
+    if ( (unsigned long)(end - *p) < sizeof(sec) ) return NULL;
+    memcpy (&sec, *p, sizeof(sec));
+    if ( memcmp (sec.id, id, 4) || sec.size != size || end - *p - sizeof(sec) < size ) return NULL;
+    data = *p + sizeof(sec);
+    *p = data + size;
+    return data;
+}
+
+int NESStateRead (ContextNES *nes, const unsigned char *buf, unsigned long size)
+{
+    NESStateHeader hdr;
+    StateCart cart;
+    StateBus bus;
+    const unsigned char *p = buf + sizeof(hdr), *end = buf + size;
+    const unsigned char *data[RAW_SECTIONS], *cd, *bd;
+    unsigned n;
+
+    // Validate everything first, context is not touched by invalid state.
+    if ( size < sizeof(hdr) ) return 0;
+    memcpy (&hdr, buf, sizeof(hdr));
+    if ( memcmp (hdr.magic, NES_STATE_MAGIC, 4) || hdr.version != NES_STATE_VERSION || hdr.sections != SECTIONS || hdr.size != size ) return 0;
+
+    if ( (cd = GetSection (&p, end, "CART", sizeof(cart))) == NULL ) return 0;
+    memcpy (&cart, cd, sizeof(cart));
+    if ( cart.mapper != (unsigned long)nes->cart.mapper || cart.prg_size != nes->cart.prg_size || cart.chr_size != nes->cart.chr_size ) return 0;
+
+    for (n=0; n<RAW_SECTIONS; n++) {
+        if ( (data[n] = GetSection (&p, end, sections[n].id, sections[n].size)) == NULL ) return 0;
+    }
+    if ( (bd = GetSection (&p, end, "BUS ", sizeof(bus))) == NULL ) return 0;
+    memcpy (&bus, bd, sizeof(bus));
+
+    for (n=0; n<RAW_SECTIONS; n++) {
+        memcpy ( (unsigned char *)nes + sections[n].offset, data[n], sections[n].size );
+    }
+    nes->mem.bus = bus.bus;
+    nes->mem.dbe = bus.dbe ? &nes->ppu : NULL;
+    nes->vmem.addr = bus.vaddr;
+    CartRemap (&nes->cart);
+    return 1;
+}
+
+int NESStateSave (ContextNES *nes, const char *path)
+{
+    unsigned long size = NESStateSize (nes);
+    unsigned char *buf = (unsigned char *)malloc (size);
+    FILE *f;
+    int ok;
+
+    if (buf == NULL) return 0;
+    NESStateWrite (nes, buf);
+
+    f = fopen (path, "wb");
+    ok = f != NULL && fwrite (buf, 1, size, f) == size;
+    if (f && fclose (f)) ok = 0;
+    free (buf);
+    return ok;
+}
+
+int NESStateLoad (ContextNES *nes, const char *path)
+{
+    Image img;
+    int ok;
+
+    if ( !ImageOpen (&img, path) ) return 0;
+    ok = NESStateRead (nes, img.data, img.size);
+    ImageClose (&img);
+    return ok;
+}
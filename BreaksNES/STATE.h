@@ -0,0 +1,39 @@
+// Whole-system savestates: board clock phase, 2A03 (6502 core and APU), PPU, RAM, nametables, mapper, controllers.
+//
+// File: header, then tagged sections. Chip contexts are stored as raw structures, so states are bit-exact,
+// but only valid for same build layout: section size is checked on load, and version is bumped when
+// layout changes. Byte order is native.
+// Page table pointers are not saved, they are rebuilt from mapper state on load.
+#pragma once
+
+#include "BOARD.h"
+
+#define NES_STATE_MAGIC     "BNES"
+#define NES_STATE_VERSION   13
+
+typedef struct NESStateHeader
+{
+    char    magic[4];
+    unsigned long   version;
+    unsigned long   sections;
+    unsigned long   size;           // total state size including header
+} NESStateHeader;
+
+typedef struct NESStateSection
+{
+    char    id[4];
+    unsigned long   size;           // data size, data follows
+} NESStateSection;
+
+// Serialized size (same for all states of this build).
+unsigned long NESStateSize (ContextNES *nes);
+
+// Serialize to memory. Buffer must be NESStateSize bytes. Returns bytes written.
+unsigned long NESStateWrite (ContextNES *nes, unsigned char *buf);
+
+// Restore from memory. Returns 0 if state is not valid for this build or cartridge.
+int NESStateRead (ContextNES *nes, const unsigned char *buf, unsigned long size);
+
+// File versions: save is one buffered write, load maps file.
+int NESStateSave (ContextNES *nes, const char *path);
+int NESStateLoad (ContextNES *nes, const char *path);
@@ -0,0 +1,163 @@
+// Threads, atomics and CPU pinning for board-level emulation.
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include "THREAD.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct ThreadStart
+{
+    void    (*proc)(void *arg);
+    void    *arg;
+#ifdef _WIN32
+    HANDLE  handle;
+#else
+    pthread_t   handle;
+#endif
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI ThreadProc (LPVOID arg)
+{
+    ThreadStart *ts = (ThreadStart *)arg;
+    ts->proc (ts->arg);
+    return 0;
+}
+#else
+static void * ThreadProc (void *arg)
+{
+    ThreadStart *ts = (ThreadStart *)arg;
+    ts->proc (ts->arg);
+    return NULL;
+}
+#endif
+
+Thread ThreadCreate (void (*proc)(void *arg), void *arg)
+{
+    ThreadStart *ts = (ThreadStart *)malloc (sizeof(ThreadStart));
+    if (ts == NULL) return NULL;
+    ts->proc = proc;
+    ts->arg = arg;
+
+#ifdef _WIN32
+    ts->handle = CreateThread (NULL, 0, ThreadProc, ts, 0, NULL);
+    if (ts->handle == NULL) {
+        free (ts);
+        return NULL;
+    }
+#else
+    if ( pthread_create (&ts->handle, NULL, ThreadProc, ts) ) {
+        free (ts);
+        return NULL;
+    }
+#endif
+    return ts;
+}
+
+void ThreadJoin (Thread t)
+{
+    ThreadStart *ts = (ThreadStart *)t;
+    if (ts == NULL) return;
+#ifdef _WIN32
+    WaitForSingleObject (ts->handle, INFINITE);
+    CloseHandle (ts->handle);
+#else
+    pthread_join (ts->handle, NULL);
+#endif
+    free (ts);
+}
+
+void ThreadYield (void)
+{
+#ifdef _WIN32
+    Sleep (0);
+#else
+    sched_yield ();
+#endif
+}
+
+void ThreadSleep (int ms)
+{
+#ifdef _WIN32
+    Sleep (ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep (&ts, NULL);
+#endif
+}
+
+int ThreadCores (void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo (&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int ThreadPin (int core)
+{
+#ifdef _WIN32
+    return SetThreadAffinityMask (GetCurrentThread (), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (core, &set);
+    return pthread_setaffinity_np (pthread_self (), sizeof(set), &set) == 0;
+#else
+    return 0;
+#endif
+}
+
+void * ThreadAlloc (unsigned long size)
+{
+#ifdef _WIN32
+    UCHAR node;
+    if ( !GetNumaProcessorNode ((UCHAR)GetCurrentProcessorNumber (), &node) ) node = 0;
+    return VirtualAllocExNuma (GetCurrentProcess (), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+#else
+    // Pages go to node of thread that touches them first.
+    void *mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+    memset (mem, 0, size);
+    return mem;
+#endif
+}
+
+void ThreadFree (void *mem, unsigned long size)
+{
+    if (mem == NULL) return;
+#ifdef _WIN32
+    VirtualFree (mem, 0, MEM_RELEASE);
+#else
+    munmap (mem, size);
+#endif
+}
+
+double ThreadTime (void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter (&count);
+    QueryPerformanceFrequency (&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
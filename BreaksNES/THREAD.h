@@ -0,0 +1,29 @@
+// Threads and CPU pinning for board-level emulation. Atomics come from BreaksCommon.
+#pragma once
+
+#include "../BreaksCommon/ATOMIC.h"
+
+typedef void * Thread;
+
+// Create/join thread. Returns NULL on failure.
+Thread ThreadCreate (void (*proc)(void *arg), void *arg);
+void ThreadJoin (Thread t);
+
+// Give up time slice.
+void ThreadYield (void);
+
+// Sleep for milliseconds (idle background workers).
+void ThreadSleep (int ms);
+
+// Number of online cores.
+int ThreadCores (void);
+
+// Pin calling thread to core. Returns 0 if not supported.
+int ThreadPin (int core);
+
+// Zeroed memory on NUMA node of calling thread (pin thread first). Returns NULL on failure.
+void * ThreadAlloc (unsigned long size);
+void ThreadFree (void *mem, unsigned long size);
+
+// Monotonic wall clock, seconds.
+double ThreadTime (void);
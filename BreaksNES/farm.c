@@ -0,0 +1,24 @@
+// Headless regression farm: farm manifest [workers]
+#include <stdio.h>
+#include <stdlib.h>
+#include "FARM.h"
+
+int main (int argc, char **argv)
+{
+    Farm farm;
+    long bad;
+
+    if ( argc < 2 ) {
+        printf ("Usage: farm manifest [workers]\n");
+        return 2;
+    }
+    if ( !FarmLoad (&farm, argv[1]) ) {
+        printf ("Cannot read %s\n", argv[1]);
+        return 2;
+    }
+
+    FarmRun (&farm, argc > 2 ? atoi (argv[2]) : 0);
+    bad = FarmReport (&farm, stdout);
+    FarmFree (&farm);
+    return bad != 0;
+}
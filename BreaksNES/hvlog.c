@@ -0,0 +1,16 @@
+// PPU control line log to text: hvlog log
+#include <stdio.h>
+#include "../BreaksPPU/PPU.h"
+
+int main (int argc, char **argv)
+{
+    if ( argc < 2 ) {
+        printf ("Usage: hvlog log\n");
+        return 2;
+    }
+    if ( !PPULogPrint (argv[1], stdout) ) {
+        printf ("Cannot read %s\n", argv[1]);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+set PATH=c:\lcc\bin
+
+lc -nw -O farm.c FARM.c MOVIE.c STATE.c REWIND.c JOYPAD.c CD4021.c BOARD.c CORES.c DUMP.c MEMMAP.c NTSC.c CART.c IMAGE.c THREAD.c ..\BreaksAPU\APU.c ..\BreaksPPU\PPU.c -o farm.exe
+lc -nw -O -dll LIBBREAKS.c BOARD.c CART.c CD4021.c CORES.c DUMP.c IMAGE.c JOYPAD.c MEMMAP.c MOVIE.c NTSC.c REWIND.c STATE.c THREAD.c ..\BreaksAPU\APU.c ..\BreaksPPU\PPU.c -o libbreaks.dll
+lc -nw hvlog.c ..\BreaksPPU\PPU.c -o hvlog.exe
\ No newline at end of file
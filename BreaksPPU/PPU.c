@@ -1,6 +1,12 @@
 // NES PPU clock-accurate emulator.
 #include "PPU.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../BreaksCommon/ATOMIC.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Global quickies.
 
@@ -14,14 +20,18 @@
 
 // Basic logic
 #define BIT(n)     ( (n) & 1 )
-int NOT(int a) { return (~a & 1); }
-int NAND(int a, int b) { return ~((a & 1) & (b & 1)) & 1; }
-int NOR(int a, int b) { return ~((a & 1) | (b & 1)) & 1; }
+static int NOT(int a) { return (~a & 1); }
+static int NAND(int a, int b) { return ~((a & 1) & (b & 1)) & 1; }
+static int NOR(int a, int b) { return ~((a & 1) | (b & 1)) & 1; }
 
-// Flip/flop
-#define FF(ff,out,r,s)  \
-    out = NOR(ff, s);   \
-    ff = NOR(out, r);
+// Bit n of packed register/bus word
+#define GETBIT(w,n)     (((w) >> (n)) & 1)
+#define SETBIT(w,n,v)   w = ((w) & ~(1UL << (n))) | ((unsigned long)((v) & 1) << (n))
+
+// Flip/flop, kept in bit n of register word w
+#define FF(w,n,out,r,s)  \
+    out = NOR(GETBIT(w,n), s);   \
+    SETBIT(w, n, NOR(out, r));
 
 // ------------------------------------------------------------------------
 // RENDER
@@ -57,68 +67,48 @@ static void PPU_PIXEL_CLOCK (ContextPPU *ppu)
     nPCLK = NOT(PCLK);
 }
 
-// Register R/W decode
-static void PPU_RWDECODE (ContextPPU *ppu)
+// Register R/W decode and register select. CPU interface is selected while /DBE is low, RW gives direction
+// and RS the register. Returns register being written (0...7) with write data put on internal data bus, -1: none.
+static int PPU_REG_SELECT (ContextPPU *ppu)
 {
+    if ( ppu->pad[PPU_nDBE] || ppu->pad[PPU_RW] ) return -1;
+    ppu->bus[PPU_BUS_DB] = ppu->pad[PPU_D] & 0xff;
+    return (int)(ppu->pad[PPU_RS] & 7);
 }
 
-static void PPU_REG_SELECT (ContextPPU *ppu)
-{
-}
+// Register and bus words
+#define HINW    (ppu->reg[PPU_REG_HIN])
+#define HOUTW   (ppu->reg[PPU_REG_HOUT])
+#define VINW    (ppu->reg[PPU_REG_VIN])
+#define VOUTW   (ppu->reg[PPU_REG_VOUT])
+#define HW      (ppu->bus[PPU_BUS_H])
+#define VW      (ppu->bus[PPU_BUS_V])
+#define HSELW   (ppu->bus[PPU_BUS_HSEL])
+#define VSELW   (ppu->bus[PPU_BUS_VSEL])
+#define HRINW   (ppu->reg[PPU_REG_HRIN])
+#define HROUTW  (ppu->reg[PPU_REG_HROUT])
+#define VRINW   (ppu->reg[PPU_REG_VRIN])
+#define VROUTW  (ppu->reg[PPU_REG_VROUT])
+#define HRW     (ppu->reg[PPU_REG_HR])
+#define VRW     (ppu->reg[PPU_REG_VR])
 
-#define HIN(n) (ppu->reg[PPU_REG_HIN][n])
-#define HOUT(n) (ppu->reg[PPU_REG_HOUT][n])
-#define VIN(n) (ppu->reg[PPU_REG_VIN][n])
-#define VOUT(n) (ppu->reg[PPU_REG_VOUT][n])
-#define H(n) (ppu->bus[PPU_BUS_H][n])
-#define nH(n) NOT(ppu->bus[PPU_BUS_H][n])
-#define V(n) (ppu->bus[PPU_BUS_V][n])
-#define nV(n) NOT(ppu->bus[PPU_BUS_V][n])
-#define HSEL(n) (ppu->bus[PPU_BUS_HSEL][n])
-#define VSEL(n) (ppu->bus[PPU_BUS_VSEL][n])
-#define HRIN(n) (ppu->reg[PPU_REG_HRIN][n])
-#define HROUT(n) (ppu->reg[PPU_REG_HROUT][n])
-#define VRIN(n) (ppu->reg[PPU_REG_VRIN][n])
-#define VROUT(n) (ppu->reg[PPU_REG_VROUT][n])
-#define HR(n) (ppu->reg[PPU_REG_HR][n])
-#define VR(n) (ppu->reg[PPU_REG_VR][n])
-
-// print asserted H/V logic outputs.
-static void dump_HV (ContextPPU *ppu)
-{
-    static int prev_h = -1;
-    int n;
-    if (nPCLK || ppu->debug[PPU_DEBUG_H] == prev_h ) return;
-    if ( ppu->debug[PPU_DEBUG_V] == 3 ) exit (0);
-    printf ( "H:%i V:%i ", ppu->debug[PPU_DEBUG_H], ppu->debug[PPU_DEBUG_V] );
-    prev_h = ppu->debug[PPU_DEBUG_H];
-
-    if ( ppu->ctrl[PPU_CTRL_SCCNT] ) printf ( " SC/CNT" );
-    if ( ppu->ctrl[PPU_CTRL_SEV] ) printf ( " S/EV" );
-    if ( ppu->ctrl[PPU_CTRL_EEV] ) printf ( " E/EV" );
-    if ( ppu->ctrl[PPU_CTRL_CLIP_O] ) printf ( " CLIP_O" );
-    if ( ppu->ctrl[PPU_CTRL_CLIP_B] ) printf ( " CLIP_B" );
-    if ( ppu->ctrl[PPU_CTRL_ZHPOS] ) printf ( " 0/HPOS" );
-    if ( ppu->ctrl[PPU_CTRL_EVAL] ) printf ( " EVAL" );
-    if ( ppu->ctrl[PPU_CTRL_IOAM2] ) printf ( " I/OAM2" );
-    if ( ppu->ctrl[PPU_CTRL_FNT] ) printf ( " F/NT" );
-    if ( ppu->ctrl[PPU_CTRL_FAT] ) printf ( " F/AT" );
-    if ( ppu->ctrl[PPU_CTRL_PARO] ) printf ( " PAR/O" );
-    if ( ppu->ctrl[PPU_CTRL_FTA] ) printf ( " F/TA" );
-    if ( ppu->ctrl[PPU_CTRL_FTB] ) printf ( " F/TB" );
-    if ( NOT(ppu->ctrl[PPU_CTRL_nFO]) ) printf ( " /FO" );
-    if ( ppu->ctrl[PPU_CTRL_VIS] ) printf ( " VIS" );
-    if ( ppu->ctrl[PPU_CTRL_BLNK] ) printf ( " BLNK" );
-    if ( ppu->ctrl[PPU_CTRL_RESCL] ) printf ( " RESCL" );
-    if ( ppu->ctrl[PPU_CTRL_PICTURE] ) printf ( " PICTURE" );
-    if ( ppu->ctrl[PPU_CTRL_SYNC] ) printf ( " SYNC" );
-    if ( NOT(ppu->ctrl[PPU_CTRL_nFPORCH]) ) printf ( " FRPORCH" );
-    if ( NOT(ppu->ctrl[PPU_CTRL_nBPORCH]) ) printf ( " BKPORCH" );
-    if ( ppu->ctrl[PPU_CTRL_BURST] ) printf ( " BURST" );
-    if ( NOT(ppu->ctrl[PPU_CTRL_nINT]) ) printf ( " /INT" );
-    
-    printf ( "\n" );
-}
+// Bits
+#define HIN(n) GETBIT(HINW, n)
+#define HOUT(n) GETBIT(HOUTW, n)
+#define VIN(n) GETBIT(VINW, n)
+#define VOUT(n) GETBIT(VOUTW, n)
+#define H(n) GETBIT(HW, n)
+#define nH(n) NOT(H(n))
+#define V(n) GETBIT(VW, n)
+#define nV(n) NOT(V(n))
+#define HSEL(n) GETBIT(HSELW, n)
+#define VSEL(n) GETBIT(VSELW, n)
+#define HRIN(n) GETBIT(HRINW, n)
+#define HROUT(n) GETBIT(HROUTW, n)
+#define VRIN(n) GETBIT(VRINW, n)
+#define VROUT(n) GETBIT(VROUTW, n)
+#define HR(n) GETBIT(HRW, n)
+#define VR(n) GETBIT(VRW, n)
 
 /*
     H/V logic input:
@@ -134,13 +124,21 @@ static void dump_HV (ContextPPU *ppu)
     connected to DB7 (for $2002.7 output).
 */
 
+// 9-bit ripple counter (H/V). Output latches take inverted input latches on PCLK, input latches take
+// outputs (counting bit) or inverted outputs on nPCLK. Carry into bit n is carry in AND outputs 0...n-1,
+// so carry mask is the run of trailing ones of outputs plus one bit.
+#define COUNTER(in,out,clear,cin)                                   \
+    if (PCLK) out = ~in & (clear ? 0 : 0x1ff);                      \
+    if (nPCLK) {                                                    \
+        carry = (cin) ? (out ^ (out + 1)) & 0x1ff : 0;              \
+        in = (carry & out & (RES ? 0 : 0x1ff)) | (~carry & ~out & 0x1ff);  \
+    }
+
 // H/V counters
 static void PPU_HV (ContextPPU *ppu)
 {
-    int n, in;
     int ff, hb, vb, blnk, cb, oe;
-
-    ppu->debug[PPU_DEBUG_H] = ppu->debug[PPU_DEBUG_V] = 0;
+    unsigned long carry, sel;
 
     // V-counter input
     ppu->ctrl[PPU_CTRL_VIN] = NOT (H(0) | H(1) | nH(2) | H(3) | nH(4) | H(5) | nH(6) | H(7) | nH(8));       // 340
@@ -150,85 +148,65 @@ static void PPU_HV (ContextPPU *ppu)
     ppu->ctrl[PPU_CTRL_VC] = NOR ( ppu->latch[PPU_FF_HC], NOT(ppu->latch[PPU_FF_VC]) );
 
     // propagate counters
-    for (n=0, in=1; n<9; n++) {   // H-counter
-        if (PCLK) {
-            HOUT(n) = NOT(HIN(n)) & NOT(ppu->ctrl[PPU_CTRL_HC]);
-        }
-        if (nPCLK) {
-            if (in) HIN(n) = HOUT(n) & NOT(RES);
-            else HIN(n) = NOT(HOUT(n));
-        }
-        // H carry
-        if ( n == 4 ) in = NOT ( NOT(HOUT(0)) | NOT(HOUT(1)) | NOT(HOUT(2)) | NOT(HOUT(3)) | NOT(HOUT(4)) );
-        else in = HOUT(n) & in;
-        H(n) = HOUT(n) & NOT(RES);
-        if (H(n)) ppu->debug[PPU_DEBUG_H] |= 1 << n;
-    }
-    for (n=0, in=ppu->ctrl[PPU_CTRL_VIN]; n<9; n++) {   // V-counter
-        if (PCLK) {
-            VOUT(n) = NOT(VIN(n)) & NOT(ppu->ctrl[PPU_CTRL_VC]);
-        }
-        if (nPCLK) {
-            if (in) VIN(n) = VOUT(n) & NOT(RES);
-            else VIN(n) = NOT(VOUT(n));
-        }
-        // V carry
-        if ( n == 4 ) in = NOT ( NOT(VOUT(0)) | NOT(VOUT(1)) | NOT(VOUT(2)) | NOT(VOUT(3)) | NOT(VOUT(4)) | NOT(ppu->ctrl[PPU_CTRL_VIN]) );
-        else in = VOUT(n) & in;
-        V(n) = VOUT(n) & NOT(RES);
-        if (V(n)) ppu->debug[PPU_DEBUG_V] |= 1 << n;
-    }
+    COUNTER (HINW, HOUTW, ppu->ctrl[PPU_CTRL_HC], 1);
+    HW = RES ? 0 : HOUTW;
+    COUNTER (VINW, VOUTW, ppu->ctrl[PPU_CTRL_VC], ppu->ctrl[PPU_CTRL_VIN]);
+    VW = RES ? 0 : VOUTW;
+    ppu->debug[PPU_DEBUG_H] = HW;
+    ppu->debug[PPU_DEBUG_V] = VW;
 
     // V select
-    VSEL(0) = NOT( nV(0) | nV(1) | nV(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) );      // 247, Vsync end
-    VSEL(1) = NOT( V(0) | V(1) | nV(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) );        // 244, Vsync start
-    VSEL(2) = NOT( nV(0) | V(1) | nV(2) | V(3) | V(4) | V(5) | V(6) | V(7) | nV(8) );   // 261, VINT end
+    sel = NOT( nV(0) | nV(1) | nV(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) ) << 0;      // 247, Vsync end
+    sel |= NOT( V(0) | V(1) | nV(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) ) << 1;        // 244, Vsync start
+    sel |= NOT( nV(0) | V(1) | nV(2) | V(3) | V(4) | V(5) | V(6) | V(7) | nV(8) ) << 2;   // 261, VINT end
     
-    VSEL(3) = NOT( nV(0) | V(1) | V(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) );        // 241, VINT start
-    VSEL(4) = NOT( nV(0) | V(1) | V(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) );        // 241, Assert VINT
-    VSEL(5) = NOT( V(0) | V(1) | V(2) | V(3) | V(4) | V(5) | V(6) | V(7) | V(8) );      // 0, Picture start
-    VSEL(6) = NOT( V(0) | V(1) | V(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) );         // 240, Vblank start
-    VSEL(7) = NOT( nV(0) | V(1) | nV(2) | V(3) | V(4) | V(5) | V(6) | V(7) | nV(8) );   // 261, Vblank end
+    sel |= NOT( nV(0) | V(1) | V(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) ) << 3;        // 241, VINT start
+    sel |= NOT( nV(0) | V(1) | V(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) ) << 4;        // 241, Assert VINT
+    sel |= NOT( V(0) | V(1) | V(2) | V(3) | V(4) | V(5) | V(6) | V(7) | V(8) ) << 5;      // 0, Picture start
+    sel |= NOT( V(0) | V(1) | V(2) | V(3) | nV(4) | nV(5) | nV(6) | nV(7) ) << 6;         // 240, Vblank start
+    sel |= NOT( nV(0) | V(1) | nV(2) | V(3) | V(4) | V(5) | V(6) | V(7) | nV(8) ) << 7;   // 261, Vblank end
 
-    VSEL(8) = NOT( nV(0) | V(1) | nV(2) | V(3) | V(4) | V(5) | V(6) | V(7) | nV(8) );   // 261, Clear reset latch
+    sel |= NOT( nV(0) | V(1) | nV(2) | V(3) | V(4) | V(5) | V(6) | V(7) | nV(8) ) << 8;   // 261, Clear reset latch
+    VSELW = sel;
 
     // Early logic
     if (nPCLK) {    // Load input latches from H/V select
-        for (n=4; n<9; n++) VRIN(n) = VSEL(n);
+        VRINW = (VRINW & 0x00f) | (VSELW & 0x1f0);
     }
-    FF(VR(6),ff,VRIN(5),VRIN(6));     // picture (lines 0...239)
+    FF(VRW,6,ff,VRIN(5),VRIN(6));     // picture (lines 0...239)
     vb = NOT(ff);
-    FF(VR(7),ff,VRIN(7),VRIN(6));     // vblank (lines 240...261)
+    FF(VRW,7,ff,VRIN(7),VRIN(6));     // vblank (lines 240...261)
     blnk = ppu->ctrl[PPU_CTRL_BLNK] = NOT(ff) | ppu->ctrl[PPU_CTRL_BLACK];
 
     // H select
-    HSEL(0) = NOT( nH(0) | nH(1) | nH(2) | H(3) | nH(4) | H(5) | H(6) | H(7) | nH(8) );       // 279, front porch end
-    HSEL(1) = NOT( H(0) | H(1) | H(2) | H(3) | H(4) | H(5) | H(6) | H(7) | nH(8) );           // 256, front porch start
-    HSEL(2) = NOT( nH(0) | H(1) | H(2) | H(3) | H(4) | H(5) | nH(6) | H(7) | H(8) | blnk );     // 65, Start OAM evaluation
-    HSEL(3) = NOT( H(3) | H(4) | H(5) | H(6) | H(7));       // 0-7, Object/Background clipping
-    HSEL(4) = NOT( H(8) | vb );             // 0-255, Object/Background clipping
-    HSEL(5) = NOT( H(2) | H(3) | nH(4) | H(5) | nH(6) | H(7) | nH(8) );     //  336-339, OAM FIFO clear H.position
-
-    HSEL(6) = NOT( nH(0) | nH(1) | nH(2) | nH(3) | nH(4) | nH(5) | H(6) | H(7) | H(8) );    // 63, OAM evaluation
-    HSEL(7) = NOT( nH(0) | nH(1) | nH(2) | nH(3) | nH(4) | nH(5) | nH(6) | nH(7) );     // 255, End OAM evaluation
-    HSEL(8) = NOT( H(6) | H(7) | H(8) );        // 0-63, Clear secondary OAM
-
-    HSEL(9) = NOT( H(6) | H(7) | nH(8) | blnk);     // 256-319, OAM pattern fetch
-    HSEL(10) = NOT( H(8) | vb | blnk);      // 0-255, Visible scanline part
-    HSEL(11) = NOT( H(1) | H(2) | blnk);        // 0/1, Name table fetch
-    HSEL(12) = NOT( nH(1) | nH(2) );        // 6/7, Pattern fetch second byte
-    HSEL(13) = NOT( H(1) | nH(2) );         // 4/5, Pattern fetch first byte
-
-    HSEL(14) = NOT( H(4) | H(5) | nH(6) | nH(8) | blnk);        // 336-340 weird two name table reads
-    HSEL(15) = NOT( H(8) | blnk);
-    HSEL(16) = NOT( nH(1) | H(2) );         // 2/3, Attribute table fetch
-    HSEL(17) = NOT( H(0) | nH(1) | nH(2) | nH(3) | H(4) | H(5) | H(6) | H(7) | nH(8) );     // 270, Back porch start
-    HSEL(18) = NOT( H(0) | H(1) | H(2) | nH(3) | H(4) | H(5) | nH(6) | H(7) | nH(8) );      // 328, Back porch end
-
-    HSEL(19) = NOT( nH(0) | nH(1) | nH(2) | H(3) | nH(4) | H(5) | H(6) | H(7) | nH(8) );    // 279, Hblank start
-    HSEL(20) = NOT( H(0) | H(1) | H(2) | H(3) | nH(4) | nH(5) | H(6) | H(7) | nH(8) );      // 304, Hblank end
-    HSEL(21) = NOT( nH(0) | nH(1) | H(2) | H(3) | H(4) | H(5) | nH(6) | H(7) | nH(8) );     // 323, Colorburst end
-    HSEL(22) = NOT( H(0) | H(1) | nH(2) | H(3) | nH(4) | nH(5) | H(6) | H(7) | nH(8) );     // 308, Colorburst start
+    sel = NOT( nH(0) | nH(1) | nH(2) | H(3) | nH(4) | H(5) | H(6) | H(7) | nH(8) ) << 0;       // 279, front porch end
+    sel |= NOT( H(0) | H(1) | H(2) | H(3) | H(4) | H(5) | H(6) | H(7) | nH(8) ) << 1;           // 256, front porch start
+    sel |= NOT( nH(0) | H(1) | H(2) | H(3) | H(4) | H(5) | nH(6) | H(7) | H(8) | blnk ) << 2;     // 65, Start OAM evaluation
+    sel |= NOT( H(3) | H(4) | H(5) | H(6) | H(7)) << 3;       // 0-7, Object/Background clipping
+    sel |= NOT( H(8) | vb ) << 4;             // 0-255, Object/Background clipping
+    sel |= NOT( H(2) | H(3) | nH(4) | H(5) | nH(6) | H(7) | nH(8) ) << 5;     //  336-339, OAM FIFO clear H.position
+
+    sel |= NOT( nH(0) | nH(1) | nH(2) | nH(3) | nH(4) | nH(5) | H(6) | H(7) | H(8) ) << 6;    // 63, OAM evaluation
+    sel |= NOT( nH(0) | nH(1) | nH(2) | nH(3) | nH(4) | nH(5) | nH(6) | nH(7) ) << 7;     // 255, End OAM evaluation
+    sel |= NOT( H(6) | H(7) | H(8) ) << 8;        // 0-63, Clear secondary OAM
+
+    sel |= NOT( H(6) | H(7) | nH(8) | blnk) << 9;     // 256-319, OAM pattern fetch
+    sel |= NOT( H(8) | vb | blnk) << 10;      // 0-255, Visible scanline part
+    sel |= NOT( H(1) | H(2) | blnk) << 11;        // 0/1, Name table fetch
+    sel |= NOT( nH(1) | nH(2) ) << 12;        // 6/7, Pattern fetch second byte
+    sel |= NOT( H(1) | nH(2) ) << 13;         // 4/5, Pattern fetch first byte
+
+    sel |= NOT( H(4) | H(5) | nH(6) | nH(8) | blnk) << 14;        // 336-340 weird two name table reads
+    sel |= NOT( H(8) | blnk) << 15;
+    sel |= NOT( nH(1) | H(2) ) << 16;         // 2/3, Attribute table fetch
+    sel |= NOT( H(0) | nH(1) | nH(2) | nH(3) | H(4) | H(5) | H(6) | H(7) | nH(8) ) << 17;     // 270, Back porch start
+    sel |= NOT( H(0) | H(1) | H(2) | nH(3) | H(4) | H(5) | nH(6) | H(7) | nH(8) ) << 18;      // 328, Back porch end
+
+    sel |= NOT( nH(0) | nH(1) | nH(2) | H(3) | nH(4) | H(5) | H(6) | H(7) | nH(8) ) << 19;    // 279, Hblank start
+    sel |= NOT( H(0) | H(1) | H(2) | H(3) | nH(4) | nH(5) | H(6) | H(7) | nH(8) ) << 20;      // 304, Hblank end
+    sel |= NOT( nH(0) | nH(1) | H(2) | H(3) | H(4) | H(5) | nH(6) | H(7) | nH(8) ) << 21;     // 323, Colorburst end
+    sel |= NOT( H(0) | H(1) | nH(2) | H(3) | nH(4) | nH(5) | H(6) | H(7) | nH(8) ) << 22;     // 308, Colorburst start
+    HSELW = sel;
 
     // odd/even
     // NOT(HSEL(5));
@@ -236,36 +214,39 @@ static void PPU_HV (ContextPPU *ppu)
 
     // H/V random logic
     if (nPCLK) {    // Load input latches from H/V select
-        for (n=0; n<23; n++) HRIN(n) = HSEL(n);
+        HRINW = HSELW;
         ppu->latch[PPU_FF_HC] = NOR (ppu->ctrl[PPU_CTRL_VIN], oe);
         ppu->latch[PPU_FF_VC] = VSEL(2);
     }
     // non-visible video signal portions control
-    FF(HR(0),ppu->ctrl[PPU_CTRL_nFPORCH],HRIN(0),HRIN(1)); // after 256 visible pixel there appear "front porch"
-    FF(VR(0),ppu->ctrl[PPU_CTRL_nBPORCH],HRIN(18),HRIN(17));        // Back porch [270-328]
-    FF(VR(1),hb,HRIN(20),HRIN(19));         // HBlank [279-304]
-    FF(VR(2),cb,HRIN(21),HRIN(22));         // Colorburst [308-323]
+    FF(HRW,0,ppu->ctrl[PPU_CTRL_nFPORCH],HRIN(0),HRIN(1)); // after 256 visible pixel there appear "front porch"
+    FF(VRW,0,ppu->ctrl[PPU_CTRL_nBPORCH],HRIN(18),HRIN(17));        // Back porch [270-328]
+    FF(VRW,1,hb,HRIN(20),HRIN(19));         // HBlank [279-304]
+    FF(VRW,2,cb,HRIN(21),HRIN(22));         // Colorburst [308-323]
     if (PCLK) {     // Check conditions and put result in output latches, alter flip/flops
-        HROUT(2) = NOT(HRIN(2));            // S/EV
-        HROUT(3) = NOR ( HRIN(3), NOT(HRIN(4)) );       // clipping appear only on left 8 pixels of visible frame
-        HROUT(5) = NOT(HRIN(5));        // 0/HPOS
-        HROUT(6) = NOT ( HRIN(5) | HRIN(6) | HRIN(7) );     // EVAL
-        HROUT(7) = NOT (HRIN(7));       // E/EV
-        HROUT(8) = NOT (HRIN(8));       // I/OAM2
-        HROUT(9) = NOT (HRIN(9));       // PAR/O
-        HROUT(10) = NOT (HRIN(10));     // VIS
-        HROUT(11) = NOT (HRIN(11));     // F/NT
-        HROUT(12) = NOT (HRIN(12));     // F/TB
-        HROUT(13) = NOT (HRIN(13));     // F/TA
-        HROUT(14) = NOR (HRIN(14), HRIN(15));   // /FO
-
-        VROUT(0) = cb;
-        VROUT(1) = ppu->ctrl[PPU_CTRL_nFPORCH];
-        FF(VR(4),ff,NAND(hb, VSEL(1)),NAND(hb, VSEL(0)));
-        VROUT(3) = NOT(ff) & NOT(hb);
-        VROUT(4) = ppu->ctrl[PPU_CTRL_nBPORCH];
-        FF(VR(5),VROUT(5),NAND(ppu->ctrl[PPU_CTRL_nBPORCH], VSEL(2)),NAND(ppu->ctrl[PPU_CTRL_nBPORCH], VSEL(3)));
-        VROUT(8) = NOT(VRIN(8));
+        sel = NOT(HRIN(2)) << 2;            // S/EV
+        sel |= NOR ( HRIN(3), NOT(HRIN(4)) ) << 3;      // clipping appear only on left 8 pixels of visible frame
+        sel |= NOT(HRIN(5)) << 5;       // 0/HPOS
+        sel |= NOT ( HRIN(5) | HRIN(6) | HRIN(7) ) << 6;    // EVAL
+        sel |= NOT (HRIN(7)) << 7;      // E/EV
+        sel |= NOT (HRIN(8)) << 8;      // I/OAM2
+        sel |= NOT (HRIN(9)) << 9;      // PAR/O
+        sel |= NOT (HRIN(10)) << 10;    // VIS
+        sel |= NOT (HRIN(11)) << 11;    // F/NT
+        sel |= NOT (HRIN(12)) << 12;    // F/TB
+        sel |= NOT (HRIN(13)) << 13;    // F/TA
+        sel |= NOR (HRIN(14), HRIN(15)) << 14;  // /FO
+        HROUTW = sel;
+
+        sel = cb;
+        sel |= ppu->ctrl[PPU_CTRL_nFPORCH] << 1;
+        FF(VRW,4,ff,NAND(hb, VSEL(1)),NAND(hb, VSEL(0)));
+        sel |= (NOT(ff) & NOT(hb)) << 3;
+        sel |= ppu->ctrl[PPU_CTRL_nBPORCH] << 4;
+        FF(VRW,5,ff,NAND(ppu->ctrl[PPU_CTRL_nBPORCH], VSEL(2)),NAND(ppu->ctrl[PPU_CTRL_nBPORCH], VSEL(3)));
+        sel |= ff << 5;
+        sel |= NOT(VRIN(8)) << 8;
+        VROUTW = sel;
     }
     // H/V logic outputs, based on output latch values, flip/flops and PPU control bits.
     ppu->ctrl[PPU_CTRL_SEV] = NOT(HROUT(2));
@@ -287,10 +268,292 @@ static void PPU_HV (ContextPPU *ppu)
     ppu->ctrl[PPU_CTRL_SYNC] = NOR(VROUT(1), VROUT(3));
     ppu->ctrl[PPU_CTRL_BURST] = NOR(VROUT(0), ppu->ctrl[PPU_CTRL_SYNC]);
     ppu->ctrl[PPU_CTRL_PICTURE] = VROUT(4) | VROUT(5);
-    // vblank / IRQ handling
-    ppu->ctrl[PPU_CTRL_nINT] = 1;
+}
+
+// ------------------------------------------------------------------------
+// H/V control word table
+
+// H/V logic is clocked by pixel clock only, its other inputs are /RES and BLACK (OBCLIP/BGCLIP only gate
+// CLIP_O/B outputs). So with BLACK fixed it repeats every frame, and its outputs are recorded once per
+// frame by gate logic as one control word per PPU step. Lines with same words share one row.
+// Table is used from start of line (H = 0) where gate registers match the recorded ones, and is left
+// on /RES or BLACK change; gate registers are then rebuilt by replay from line start.
+
+#define HV_STEPS    (341 * 8)       // PPU steps per line
+#define HV_LINES    262
+
+// Control word: hv_ctrl lines, then CLIP (before OBCLIP/BGCLIP), V already advanced, PCLK.
+static const int hv_ctrl[] = {
+    PPU_CTRL_VIN, PPU_CTRL_HC, PPU_CTRL_VC, PPU_CTRL_BLNK, PPU_CTRL_nFPORCH, PPU_CTRL_nBPORCH,
+    PPU_CTRL_SEV, PPU_CTRL_ZHPOS, PPU_CTRL_EVAL, PPU_CTRL_EEV, PPU_CTRL_IOAM2, PPU_CTRL_PARO, PPU_CTRL_VIS,
+    PPU_CTRL_FNT, PPU_CTRL_FTB, PPU_CTRL_FTA, PPU_CTRL_nFO, PPU_CTRL_FAT, PPU_CTRL_RESCL, PPU_CTRL_SCCNT,
+    PPU_CTRL_SYNC, PPU_CTRL_BURST, PPU_CTRL_PICTURE,
+};
+#define HV_BITS     (sizeof(hv_ctrl) / sizeof(hv_ctrl[0]))
+#define HV_CLIP     HV_BITS
+#define HV_VNEXT    (HV_BITS + 1)
+#define HV_PCLK     (HV_BITS + 2)
+
+// Gate registers carried from step to step: H/V counters and selectors, which come first in reg[].
+// Registers after PPU_REG_VR are render state and are left out.
+#define HV_REGS     (PPU_REG_VR + 1)
+
+typedef struct HVState
+{
+    unsigned int reg[HV_REGS];
+    char    hc, vc;
+    unsigned int h;
+} HVState;
+
+typedef struct HVTable
+{
+    volatile long ready;            // 0: not built, 1: ready, -1: H/V did not repeat, gate logic only
+    int     rows;
+    unsigned short row[HV_LINES];   // row of line
+    short   h[HV_STEPS];            // H of step
+    HVState start[HV_LINES];        // gate registers at line start
+    unsigned long *word;            // rows * HV_STEPS
+} HVTable;
 
-    dump_HV (ppu);
+static HVTable hv_table[2];         // BLACK = 0/1
+static volatile long hv_lock;
+
+static void HVSave (ContextPPU *ppu, HVState *st)
+{
+    memcpy (st->reg, ppu->reg, sizeof(st->reg));
+    st->hc = ppu->latch[PPU_FF_HC];
+    st->vc = ppu->latch[PPU_FF_VC];
+    st->h = HW;
+}
+
+static void HVLoad (ContextPPU *ppu, HVState *st)
+{
+    memcpy (ppu->reg, st->reg, sizeof(st->reg));
+    ppu->latch[PPU_FF_HC] = st->hc;
+    ppu->latch[PPU_FF_VC] = st->vc;
+    HW = st->h;
+}
+
+static int HVSame (ContextPPU *ppu, HVState *st)
+{
+    return !memcmp (ppu->reg, st->reg, sizeof(st->reg)) && ppu->latch[PPU_FF_HC] == st->hc &&
+           ppu->latch[PPU_FF_VC] == st->vc && HW == st->h;
+}
+
+static unsigned long HVWord (ContextPPU *ppu, int line)
+{
+    unsigned long w = 0;
+    int n;
+
+    for (n=0; n<(int)HV_BITS; n++) w |= (unsigned long)(ppu->ctrl[hv_ctrl[n]] & 1) << n;
+    w |= (unsigned long)NOT(HROUT(3)) << HV_CLIP;
+    w |= (unsigned long)(ppu->debug[PPU_DEBUG_V] != line) << HV_VNEXT;
+    w |= (unsigned long)(PCLK & 1) << HV_PCLK;
+    return w;
+}
+
+#define HV_LINE_START(ppu,prev)  ((ppu)->debug[PPU_DEBUG_H] == 0 && (prev) != 0)
+
+static void HVGateStep (ContextPPU *ppu)
+{
+    PPU_RESET (ppu);
+    PPU_CLOCK (ppu);
+    PPU_PIXEL_CLOCK (ppu);
+    PPU_HV (ppu);
+    ppu->pad[PPU_CLK] ^= 1;
+}
+
+// Record one frame from start of line 0, after two frames to settle from power-on.
+static int HVBuild (HVTable *t, int black)
+{
+    ContextPPU *ppu;
+    unsigned long *w, *row;
+    int line, step, prev, n, ok = 0;
+
+    ppu = (ContextPPU *)calloc (1, sizeof(ContextPPU));
+    w = (unsigned long *)malloc (HV_LINES * HV_STEPS * sizeof(unsigned long));
+    if ( ppu == NULL || w == NULL ) goto done;
+    ppu->pad[PPU_nRES] = 1;
+    ppu->ctrl[PPU_CTRL_BLACK] = black;
+
+    for (n=0; n<2*HV_LINES*HV_STEPS; n++) HVGateStep (ppu);
+    for (n=0; n<2*HV_LINES*HV_STEPS; n++) {
+        prev = ppu->debug[PPU_DEBUG_H];
+        HVGateStep (ppu);
+        if ( HV_LINE_START(ppu, prev) && ppu->debug[PPU_DEBUG_V] == 0 ) break;
+    }
+
+    t->rows = 0;
+    for (line=0; line<HV_LINES; line++) {
+        if ( ppu->debug[PPU_DEBUG_V] != line ) goto done;
+        HVSave (ppu, &t->start[line]);
+        row = &w[t->rows * HV_STEPS];
+        for (step=0; step<HV_STEPS; step++) {
+            if (step) {
+                prev = ppu->debug[PPU_DEBUG_H];
+                HVGateStep (ppu);
+                if ( HV_LINE_START(ppu, prev) ) goto done;
+            }
+            row[step] = HVWord (ppu, line);
+            if ( line == 0 ) t->h[step] = ppu->debug[PPU_DEBUG_H];
+            else if ( t->h[step] != ppu->debug[PPU_DEBUG_H] ) goto done;
+        }
+        prev = ppu->debug[PPU_DEBUG_H];
+        HVGateStep (ppu);
+        if ( !HV_LINE_START(ppu, prev) ) goto done;
+
+        for (n=0; n<t->rows; n++) {
+            if ( !memcmp (&w[n * HV_STEPS], row, HV_STEPS * sizeof(unsigned long)) ) break;
+        }
+        t->row[line] = n;
+        if ( n == t->rows ) t->rows++;
+    }
+    // Next frame must start as recorded one.
+    ok = ppu->debug[PPU_DEBUG_V] == 0 && HVSame (ppu, &t->start[0]);
+
+done:
+    if (ok) {
+        t->word = (unsigned long *)realloc (w, t->rows * HV_STEPS * sizeof(unsigned long));
+        if ( t->word == NULL ) t->word = w;
+    }
+    else free (w);
+    free (ppu);
+    return ok;
+}
+
+// Tables are shared by all PPUs and built on first use.
+static HVTable * HVTableGet (int black)
+{
+    HVTable *t = &hv_table[black];
+
+    if ( ATOMIC_LOAD (&t->ready) == 0 ) {
+        SPIN_LOCK (&hv_lock);
+        if ( t->ready == 0 ) ATOMIC_STORE (&t->ready, HVBuild (t, black) ? 1 : -1);
+        SPIN_UNLOCK (&hv_lock);
+    }
+    return t->ready > 0 ? t : NULL;
+}
+
+// Advance table position by steps and put out its word. Returns 0 (nothing changed) if pixel clock is not where table expects it.
+static int HVTableStep (ContextPPU *ppu, HVTable *t, int steps)
+{
+    PPUHV *hv = &ppu->hv;
+    int line = hv->line, step = hv->step + steps, n, clip, v;
+    unsigned long w;
+
+    if ( step >= HV_STEPS ) {
+        step -= HV_STEPS;
+        if ( ++line == HV_LINES ) line = 0;
+    }
+    w = t->word[t->row[line] * HV_STEPS + step];
+    if ( (int)((w >> HV_PCLK) & 1) != PCLK ) return 0;
+    hv->line = line;
+    hv->step = step;
+
+    for (n=0; n<(int)HV_BITS; n++) ppu->ctrl[hv_ctrl[n]] = (w >> n) & 1;
+    clip = (w >> HV_CLIP) & 1;
+    ppu->ctrl[PPU_CTRL_CLIP_O] = clip & NOT(ppu->ctrl[PPU_CTRL_OBCLIP]);
+    ppu->ctrl[PPU_CTRL_CLIP_B] = clip & NOT(ppu->ctrl[PPU_CTRL_BGCLIP]);
+
+    v = line + ((w >> HV_VNEXT) & 1);
+    ppu->debug[PPU_DEBUG_H] = hv->prev_h = t->h[step];
+    ppu->debug[PPU_DEBUG_V] = v == HV_LINES ? 0 : v;
+    return 1;
+}
+
+// Leave table. In table mode gate registers are replayed from line start with table's BLACK.
+static void HVLeave (ContextPPU *ppu)
+{
+    PPUHV *hv = &ppu->hv;
+    HVTable *t = &hv_table[hv->black];
+    int s, pclk = PCLK, res = RES, black = ppu->ctrl[PPU_CTRL_BLACK];
+    unsigned long *row;
+
+    hv->sync = 0;
+    if ( hv->mode != PPU_HV_TABLE ) return;
+
+    row = &t->word[t->row[hv->line] * HV_STEPS];
+    HVLoad (ppu, &t->start[hv->line]);
+    RES = 0;
+    ppu->ctrl[PPU_CTRL_BLACK] = hv->black;
+    for (s=1; s<=hv->step; s++) {
+        PCLK = (row[s] >> HV_PCLK) & 1;
+        nPCLK = NOT(PCLK);
+        PPU_HV (ppu);
+    }
+    PCLK = pclk;
+    nPCLK = NOT(pclk);
+    RES = res;
+    ppu->ctrl[PPU_CTRL_BLACK] = black;
+}
+
+// Enter table at line start if gate registers are as recorded.
+static void HVSync (ContextPPU *ppu, int black)
+{
+    PPUHV *hv = &ppu->hv;
+    int prev = hv->prev_h, v = ppu->debug[PPU_DEBUG_V];
+    HVTable *t;
+
+    hv->prev_h = ppu->debug[PPU_DEBUG_H];
+    if ( !HV_LINE_START(ppu, prev) || RES || v >= HV_LINES ) return;
+    t = HVTableGet (black);
+    if ( t == NULL || !HVSame (ppu, &t->start[v]) ) return;
+    hv->sync = 1;
+    hv->black = black;
+    hv->line = v;
+    hv->step = 0;
+}
+
+// H/V logic for PPU steps: 1 (one CLK edge) or 4 (pixel clock half, from its first edge).
+// Gate logic settles in two evaluations within pixel clock half, so half takes two.
+static void PPU_HV_STEP (ContextPPU *ppu, int steps)
+{
+    PPUHV *hv = &ppu->hv;
+    int black = ppu->ctrl[PPU_CTRL_BLACK] & 1;
+    char ctrl[PPU_CTRL_MAX];
+    int h, v;
+    HVTable *t;
+
+    if ( hv->sync ) {
+        t = HVTableGet (hv->black);
+        if ( t == NULL ) hv->sync = 0;      // state saved by build with table, gate registers are stale
+        else if ( RES || black != hv->black ) HVLeave (ppu);
+        else if ( hv->mode == PPU_HV_TABLE ) {
+            if ( HVTableStep (ppu, t, steps) ) return;
+            HVLeave (ppu);
+        }
+        else {
+            if ( HVTableStep (ppu, t, steps) ) {
+                memcpy (ctrl, ppu->ctrl, sizeof(ctrl));
+                h = ppu->debug[PPU_DEBUG_H];
+                v = ppu->debug[PPU_DEBUG_V];
+                PPU_HV (ppu);
+                if ( steps > 1 ) PPU_HV (ppu);
+                if ( !memcmp (ctrl, ppu->ctrl, sizeof(ctrl)) && h == ppu->debug[PPU_DEBUG_H] && v == ppu->debug[PPU_DEBUG_V] ) return;
+            }
+            else {
+                PPU_HV (ppu);
+                if ( steps > 1 ) PPU_HV (ppu);
+            }
+            hv->errors++;
+            hv->sync = 0;
+            hv->prev_h = ppu->debug[PPU_DEBUG_H];
+            return;
+        }
+    }
+
+    PPU_HV (ppu);
+    if ( hv->mode != PPU_HV_GATE ) HVSync (ppu, black);
+    if ( steps > 1 ) {      // rest of pixel clock half
+        if ( hv->sync ) HVTableStep (ppu, HVTableGet (black), steps - 1);
+        if ( !hv->sync || hv->mode == PPU_HV_VERIFY ) PPU_HV (ppu);
+    }
+}
+
+void PPUSetHV (ContextPPU *ppu, int mode)
+{
+    if ( ppu->hv.sync && mode != ppu->hv.mode ) HVLeave (ppu);
+    ppu->hv.mode = mode;
 }
 
 // ------------------------------------------------------------------------
@@ -298,8 +561,140 @@ static void PPU_HV (ContextPPU *ppu)
 
 // Control registers -> OAM counters control -> Primary OAM counter -> Secondary OAM counter -> OAM evaluation -> OAM H-selector -> MUX
 
+#define OAMCNT      (ppu->reg[PPU_REG_OAMCNT])
+#define OAM2CNT     (ppu->reg[PPU_REG_OAM2CNT])
+#define OB          (ppu->reg[PPU_REG_OB])
+
+// $2000/$2001 -> control lines. Registers take data for as long as write is selected (same value again),
+// so they are updated on every step, before H/V logic which takes BLACK.
+// Register clear (RC) is not modeled: lines keep their power-on values (see board) until first write.
 static void PPU_CONTROL_REGS (ContextPPU *ppu)
 {
+    int d;
+
+    switch (PPU_REG_SELECT (ppu)) {
+        case 0:
+            d = (int)ppu->bus[PPU_BUS_DB];
+            ppu->reg[PPU_REG_SCROLL] = (ppu->reg[PPU_REG_SCROLL] & ~0xc00UL) | (unsigned long)(d & 3) << 10;    // NTH, NTV
+            ppu->ctrl[PPU_CTRL_I32] = (d >> 2) & 1;
+            ppu->ctrl[PPU_CTRL_OBSEL] = (d >> 3) & 1;
+            ppu->ctrl[PPU_CTRL_BGSEL] = (d >> 4) & 1;
+            ppu->ctrl[PPU_CTRL_O816] = (d >> 5) & 1;
+            ppu->ctrl[PPU_CTRL_VBL] = (d >> 7) & 1;
+            break;
+        case 1:
+            d = (int)ppu->bus[PPU_BUS_DB];
+            ppu->ctrl[PPU_CTRL_BW] = d & 1;
+            ppu->ctrl[PPU_CTRL_BGCLIP] = (d >> 1) & 1;
+            ppu->ctrl[PPU_CTRL_OBCLIP] = (d >> 2) & 1;
+            ppu->ctrl[PPU_CTRL_BLACK] = NOR(d >> 3, d >> 4);
+            ppu->ctrl[PPU_CTRL_nTR] = NOT(d >> 5);
+            ppu->ctrl[PPU_CTRL_nTG] = NOT(d >> 6);
+            ppu->ctrl[PPU_CTRL_nTB] = NOT(d >> 7);
+            break;
+    }
+}
+
+// Y comparator for all 256 primary OAM bytes at once (line V - byte in 0...height-1). Any byte may be
+// compared as Y: sprite overflow check steps byte counter along with sprite counter.
+// Comparator takes V0-V7 only, so on line 261 Y is compared against 5.
+static void OAMRange (ContextPPU *ppu, int v, int height)
+{
+    const unsigned char *oam = &ppu->mem[PPU_MEM_OAM];
+    int n;
+
+    v &= 0xff;
+#if defined(__SSE2__)
+    __m128i line = _mm_set1_epi8 ((char)v), top = _mm_set1_epi8 ((char)(height - 1)), zero = _mm_setzero_si128 (), y, in;
+    unsigned long long mask;
+
+    for (n=0; n<16; n++) {
+        y = _mm_loadu_si128 ((const __m128i *)(oam + n * 16));
+        in = _mm_and_si128 (_mm_cmpeq_epi8 (_mm_subs_epu8 (y, line), zero),
+            _mm_cmpeq_epi8 (_mm_subs_epu8 (_mm_subs_epu8 (line, y), top), zero));
+        mask = (unsigned long long)(unsigned)_mm_movemask_epi8 (in) << ((n & 3) * 16);
+        if ( (n & 3) == 0 ) ppu->oam_range[n >> 2] = mask;
+        else ppu->oam_range[n >> 2] |= mask;
+    }
+#else
+    memset (ppu->oam_range, 0, sizeof(ppu->oam_range));
+    for (n=0; n<256; n++) {
+        if ( v >= oam[n] && v - oam[n] < height ) ppu->oam_range[n >> 6] |= 1ULL << (n & 63);
+    }
+#endif
+}
+
+// Compare/write step of evaluation (second dot of pair), on byte read into OAM buffer on first dot.
+// Byte is written to secondary OAM while it is not full; counter advances only for sprites in range.
+// With 8 sprites found, byte is still compared as Y, but sprite and byte counters both advance on miss
+// (no carry from byte counter): overflow flag then comes from wrong bytes, the hardware bug.
+static void OAMEvalStep (ContextPPU *ppu)
+{
+    unsigned char *oam2 = &ppu->mem[PPU_MEM_TEMP];
+    int full = (OAM2CNT >> 5) & 1, in;
+
+    if ( !full ) oam2[OAM2CNT] = (unsigned char)OB;
+    if ( ppu->latch[PPU_FF_OAMDONE] ) {
+        OAMCNT = (OAMCNT + 4) & 0xfc;
+        return;
+    }
+
+    if ( ppu->latch[PPU_FF_COPY] ) {
+        if ( !full ) OAM2CNT++;
+        OAMCNT++;
+        if ( (OAMCNT & 3) == 0 ) {
+            ppu->latch[PPU_FF_COPY] = 0;
+            if ( full ) ppu->latch[PPU_FF_OAMDONE] = 1;     // after overflow only failed copies of Y
+        }
+    }
+    else {
+        in = (int)(ppu->oam_range[OAMCNT >> 6] >> (OAMCNT & 63)) & 1;
+        if (in) {
+            if ( full ) ppu->latch[PPU_FF_OFLOW] = 1;
+            else {
+                if ( OAMCNT == 0 ) ppu->latch[PPU_FF_SPR0] = 1;
+                OAM2CNT++;
+            }
+            ppu->latch[PPU_FF_COPY] = 1;
+            OAMCNT++;
+        }
+        else if ( full ) OAMCNT = ((OAMCNT + 4) & 0x1fc) | ((OAMCNT + 1) & 3);
+        else OAMCNT += 4;
+    }
+    if ( OAMCNT > 0xff ) {
+        OAMCNT &= 0xff;
+        ppu->latch[PPU_FF_OAMDONE] = 1;
+    }
+}
+
+// Once per dot (PCLK high), after H/V logic. Dot pairs: odd H reads, even H writes.
+// I/OAM2 fills secondary OAM with $FF. S/EV clears counters and compares Y of line for all of OAM;
+// evaluation then runs through dot of E/EV. Overflow and sprite 0 hit flags are cleared on pre-render line (RESCL).
+// Primary OAM counter is also $2003 address: it is held at 0 through sprite pattern fetch (PAR/O).
+static void PPU_OAM_EVAL (ContextPPU *ppu)
+{
+    int h = ppu->debug[PPU_DEBUG_H];
+
+    if ( ppu->ctrl[PPU_CTRL_RESCL] ) ppu->latch[PPU_FF_OFLOW] = ppu->latch[PPU_FF_SPR0HIT] = 0;
+    if ( ppu->ctrl[PPU_CTRL_PARO] ) OAMCNT = 0;
+
+    if ( ppu->ctrl[PPU_CTRL_IOAM2] ) {
+        if ( (h & 1) == 0 ) ppu->mem[PPU_MEM_TEMP + (((h - 1) >> 1) & 31)] = 0xff;
+        OAM2CNT = 0;
+    }
+
+    if ( ppu->ctrl[PPU_CTRL_SEV] ) {
+        OAMCNT = OAM2CNT = 0;
+        ppu->latch[PPU_FF_OAMEV] = 1;
+        ppu->latch[PPU_FF_COPY] = ppu->latch[PPU_FF_OAMDONE] = ppu->latch[PPU_FF_SPR0] = 0;
+        OAMRange (ppu, ppu->debug[PPU_DEBUG_V], ppu->ctrl[PPU_CTRL_O816] ? 16 : 8);
+        return;
+    }
+    if ( !ppu->latch[PPU_FF_OAMEV] ) return;
+
+    if ( h & 1 ) OB = ppu->mem[PPU_MEM_OAM + OAMCNT];
+    else OAMEvalStep (ppu);
+    if ( ppu->ctrl[PPU_CTRL_EEV] ) ppu->latch[PPU_FF_OAMEV] = 0;
 }
 
 // ------------------------------------------------------------------------
@@ -312,27 +707,773 @@ static void PPU_CONTROL_REGS (ContextPPU *ppu)
 
 // H-inversion -> PPU buffer -> H-counters -> Attributes -> Shift registers -> OAM Priority
 
+// 8 units, packed: H-counters are bytes of one word, shift registers are 16-bit lanes with both pattern
+// bits of each pixel side by side, so one dot of all units is a few SIMD operations.
+
+// Pattern byte bit n to bit 2n (H-inversion: bit 7 - n first).
+static unsigned Spread (unsigned b, int inv)
+{
+    if (inv) {
+        b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+        b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+        b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+    }
+    b = (b | (b << 4)) & 0x0f0f;
+    b = (b | (b << 2)) & 0x3333;
+    return (b | (b << 1)) & 0x5555;
+}
+
+// Pattern address of sprite in secondary OAM slot (PAR/O): row of line V in sprite, V-inversion.
+// 8x16 sprites take pattern table from tile bit 0.
+static unsigned ObjAddr (ContextPPU *ppu, int slot, int plane)
+{
+    const unsigned char *spr = &ppu->mem[PPU_MEM_TEMP + slot * 4];
+    unsigned tile = spr[1];
+    int height = ppu->ctrl[PPU_CTRL_O816] ? 16 : 8, row = ((ppu->debug[PPU_DEBUG_V] - spr[0]) & (height - 1));
+
+    if ( spr[2] & 0x80 ) row ^= height - 1;
+
+    if ( ppu->ctrl[PPU_CTRL_O816] ) tile = (tile & 1) << 8 | (tile & 0xfe) | row >> 3;
+    else tile |= ppu->ctrl[PPU_CTRL_OBSEL] << 8;
+    return tile << 4 | plane << 3 | (row & 7);
+}
+
+// Load unit from secondary OAM slot and pattern bytes, at end of sprite fetch. Slots past sprites found by
+// evaluation (dummy fetches of tile $FF) give transparent pattern; so does pre-render line, first line shows no sprites.
+// Unit 0 takes sprite 0 flag of evaluation, as S/EV of next line clears it.
+static void ObjLoad (ContextPPU *ppu, int slot, unsigned lo, unsigned hi)
+{
+    const unsigned char *spr = &ppu->mem[PPU_MEM_TEMP + slot * 4];
+    int inv = (spr[2] >> 6) & 1;
+
+    if ( slot >= (int)(OAM2CNT >> 2) || ppu->ctrl[PPU_CTRL_RESCL] ) lo = hi = 0;
+    ppu->obj_shift[slot] = (unsigned short)(Spread (lo, inv) | Spread (hi, inv) << 1);
+    ppu->obj_attr[slot] = spr[2];
+    ppu->obj_cnt = (ppu->obj_cnt & ~(0xffULL << (slot * 8))) | (unsigned long long)spr[3] << (slot * 8);
+    if ( slot == 0 ) ppu->latch[PPU_FF_OBJ0] = ppu->latch[PPU_FF_SPR0];
+}
+
+// One visible dot of all units. Unit with H-counter 0 puts out its pixel and shifts, other counters count down.
+// Pixels go to pix[0...7] (0: transparent), pix[8] is 0. Returns first unit with opaque pixel, 8 if none.
+static int ObjStep (ContextPPU *ppu, unsigned short pix[9])
+{
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128 (), cnt, act, sh, p;
+    int mask;
+
+    cnt = _mm_loadl_epi64 ((const __m128i *)&ppu->obj_cnt);
+    act = _mm_cmpeq_epi8 (cnt, zero);
+    act = _mm_unpacklo_epi8 (act, act);
+    sh = _mm_loadu_si128 ((const __m128i *)ppu->obj_shift);
+    p = _mm_and_si128 (_mm_srli_epi16 (sh, 14), act);
+    _mm_storeu_si128 ((__m128i *)pix, p);
+    mask = _mm_movemask_epi8 (_mm_cmpgt_epi16 (p, zero)) | 0x10000;
+    sh = _mm_or_si128 (_mm_and_si128 (act, _mm_slli_epi16 (sh, 2)), _mm_andnot_si128 (act, sh));
+    _mm_storeu_si128 ((__m128i *)ppu->obj_shift, sh);
+    _mm_storel_epi64 ((__m128i *)&ppu->obj_cnt, _mm_subs_epu8 (cnt, _mm_set1_epi8 (1)));
+    pix[8] = 0;
+    return __builtin_ctz (mask) >> 1;
+#else
+    unsigned long long cnt = ppu->obj_cnt, low = 0x7f7f7f7f7f7f7f7fULL, zero;
+    int n, first = 8;
+
+    zero = ~(((cnt & low) + low) | cnt | low);      // bit 7 of byte n: counter n is 0
+    for (n=7; n>=0; n--) {
+        pix[n] = (unsigned short)((ppu->obj_shift[n] >> 14) & -(int)((zero >> (n * 8 + 7)) & 1));
+        if ( (zero >> (n * 8 + 7)) & 1 ) ppu->obj_shift[n] <<= 2;
+        if ( pix[n] ) first = n;
+    }
+    ppu->obj_cnt = cnt - ((~zero >> 7) & 0x0101010101010101ULL);
+    pix[8] = 0;
+    return first;
+#endif
+}
+
 // ------------------------------------------------------------------------
 // DATA READER / address decoder
 
 // Scroll registers -> PAR controls -> PAR counters -> V-inversion -> PAR -> Pattern readout -> BG color -> Address decoder
 
+// Scroll registers and fine H are loaded by $2005/$2006 writes (CPU interface). PAR counters count tiles across
+// (TH, carry into NTH) and rows down (FV, TV, NTV): TV goes to next name table after row 29, wraps after 31.
+// PAR is also VRAM address of $2007 access (bits 0-13), which steps it by 1 or 32 as whole 15-bit word.
+#define SCROLL      (ppu->reg[PPU_REG_SCROLL])
+#define PAR         (ppu->reg[PPU_REG_PAR])
+
+static void ParNextTile (ContextPPU *ppu)
+{
+    if ( (PAR & 0x1f) == 0x1f ) PAR = (PAR & ~0x1fUL) ^ 0x400;
+    else PAR++;
+}
+
+static void ParNextRow (ContextPPU *ppu)
+{
+    unsigned long tv = (PAR >> 5) & 0x1f;
+
+    if ( (PAR & 0x7000) != 0x7000 ) {
+        PAR += 0x1000;
+        return;
+    }
+    if ( tv == 29 ) PAR ^= 0x800;
+    tv = tv == 29 || tv == 31 ? 0 : tv + 1;
+    PAR = (PAR & ~0x73e0UL) | tv << 5;
+}
+
+static void ParNextAccess (ContextPPU *ppu)
+{
+    PAR = (PAR + (ppu->ctrl[PPU_CTRL_I32] ? 32 : 1)) & 0x7fff;
+}
+
+// PAR controls, once per dot: H part from scroll registers at start of PAR/O (first dot after last tile),
+// V part during SC/CNT of pre-render line (RESCL).
 static void PPU_SCROLL_REGS (ContextPPU *ppu)
 {
+    if ( ppu->ctrl[PPU_CTRL_PARO] && ppu->debug[PPU_DEBUG_H] == 257 ) PAR = (PAR & ~0x41fUL) | (SCROLL & 0x41f);
+    if ( ppu->ctrl[PPU_CTRL_SCCNT] && ppu->ctrl[PPU_CTRL_RESCL] ) PAR = (PAR & 0x41f) | (SCROLL & 0x7be0);
+}
+
+// Pattern byte bit n to bit 4n.
+static unsigned long Spread4 (unsigned long b)
+{
+    b = (b | (b << 12)) & 0x000f000fUL;
+    b = (b | (b << 6)) & 0x03030303UL;
+    return (b | (b << 3)) & 0x11111111UL;
+}
+
+// Pattern readout: tile fetched by F/NT, F/AT, F/TA, F/TB goes to low half of shift registers (8 pixels of
+// attribute and pattern bits), at end of F/TB. High half holds tile being drawn.
+static void BGLoad (ContextPPU *ppu, unsigned long hi)
+{
+    unsigned long tile = Spread4 (ppu->reg[PPU_REG_TA]) | Spread4 (hi) << 1 | (ppu->reg[PPU_REG_AT] * 0x11111111UL) << 2;
+
+    ppu->bg_shift = (ppu->bg_shift & ~0xffffffffULL) | tile;
 }
 
+// BG color of dot: pixel at fine H, then shift registers shift by pixel on fetch dots (/FO high, H 1-256 and
+// 321-336). Transparent and clipped pixels are 0 (backdrop).
+static int BGStep (ContextPPU *ppu)
+{
+    int bg = (int)(ppu->bg_shift >> (60 - 4 * (ppu->reg[PPU_REG_FH] & 7))) & 15;
+
+    ppu->bg_shift <<= 4 * ppu->ctrl[PPU_CTRL_nFO];
+    return bg & -(((bg & 3) != 0) & NOT(ppu->ctrl[PPU_CTRL_CLIP_B]));
+}
+
+// $2007 memory cycle is dot pair too: PAR to AD with ALE high, then /RD (data taken by PPU_READ) or /WR with
+// write data on AD. PAR steps once cycle is done.
+static void AccessCycle (ContextPPU *ppu)
+{
+    if ( !ppu->latch[PPU_FF_RDREQ] && !ppu->latch[PPU_FF_WRREQ] ) return;
+    if ( !ppu->latch[PPU_FF_VADR] ) {
+        ppu->pad[PPU_ALE] = 1;
+        ppu->pad[PPU_AD] = PAR & 0x3fff;
+        ppu->latch[PPU_FF_VADR] = 1;
+    }
+    else if ( ppu->latch[PPU_FF_RDREQ] ) ppu->pad[PPU_nRD] = 0;
+    else {
+        ppu->pad[PPU_nWR] = 0;
+        ppu->pad[PPU_AD] = ppu->reg[PPU_REG_WB];
+        ppu->latch[PPU_FF_WRREQ] = ppu->latch[PPU_FF_VADR] = 0;
+        ParNextAccess (ppu);
+    }
+}
+
+// Fetch is dot pair: first dot puts address on AD and PA8-13 with ALE high (address is latched outside),
+// second dot reads with /RD low, data is taken at end of it (PPU_READ). Once per dot.
+// F/NT, F/AT, F/TA, F/TB: name table byte, attribute byte, pattern bytes of tile at PAR.
+// PAR/O: 8 dots per secondary OAM slot, name table byte (not used) at dots 1-2, sprite pattern at dots 5-8.
+// Dots without fetch run $2007 memory cycle, if one is pending.
 static void PPU_ADDR_DECODE (ContextPPU *ppu)
 {
+    int h = ppu->debug[PPU_DEBUG_H], dot = h & 7, fetch;
+    unsigned long addr;
+
+    fetch = ppu->ctrl[PPU_CTRL_FNT] | ppu->ctrl[PPU_CTRL_FAT] | ppu->ctrl[PPU_CTRL_FTA] | ppu->ctrl[PPU_CTRL_FTB];
+    fetch |= ppu->ctrl[PPU_CTRL_PARO] & (dot >= 5 || dot == 0);
+    ppu->pad[PPU_ALE] = fetch & h;
+    ppu->pad[PPU_nRD] = NOT(fetch & NOT(h));
+    ppu->pad[PPU_nWR] = 1;
+    if ( !fetch ) {
+        AccessCycle (ppu);
+        return;
+    }
+    if ( !ppu->pad[PPU_ALE] ) return;
+
+    if ( ppu->ctrl[PPU_CTRL_FNT] ) addr = 0x2000 | (PAR & 0xfff);
+    else if ( ppu->ctrl[PPU_CTRL_FAT] ) addr = 0x23c0 | (PAR & 0xc00) | ((PAR >> 4) & 0x38) | ((PAR >> 2) & 7);
+    else if ( ppu->ctrl[PPU_CTRL_FTA] || ppu->ctrl[PPU_CTRL_FTB] ) {
+        addr = ppu->ctrl[PPU_CTRL_BGSEL] << 12 | ppu->reg[PPU_REG_NT] << 4 | ppu->ctrl[PPU_CTRL_FTB] << 3 | ((PAR >> 12) & 7);
+    }
+    else addr = ObjAddr (ppu, ((h - 257) >> 3) & 7, (h >> 1) & 1);
+    ppu->pad[PPU_AD] = addr;
+}
+
+// PCLK low half of read dot: data from AD to PD bus, then to fetch latches. F/AT is off by then, so latch
+// is chosen by dot of pair group: name table byte, attribute, pattern low byte, pattern high byte.
+// Last pattern byte of tile loads shift registers and moves PAR to next tile; after last tile of line (H 256)
+// PAR moves to next row too. In PAR/O it loads OAM FIFO unit. Read of $2007 cycle goes to read buffer.
+static void PPU_READ (ContextPPU *ppu)
+{
+    int h = ppu->debug[PPU_DEBUG_H];
+    unsigned long pd;
+
+    if ( ppu->pad[PPU_nRD] ) return;
+    pd = ppu->bus[PPU_BUS_PD] = ppu->pad[PPU_AD] & 0xff;
+    if ( ppu->latch[PPU_FF_RDREQ] && ppu->latch[PPU_FF_VADR] ) {
+        ppu->reg[PPU_REG_RB] = pd;
+        ppu->latch[PPU_FF_RDREQ] = ppu->latch[PPU_FF_VADR] = 0;
+        ParNextAccess (ppu);
+        return;
+    }
+    switch (h & 7) {
+        case 2:
+            ppu->reg[PPU_REG_NT] = pd;
+            break;
+        case 4:
+            ppu->reg[PPU_REG_AT] = (pd >> (((PAR >> 4) & 4) | (PAR & 2))) & 3;
+            break;
+        case 6:
+            ppu->reg[PPU_REG_TA] = pd;
+            break;
+        case 0:
+            if ( ppu->ctrl[PPU_CTRL_PARO] ) {
+                ObjLoad (ppu, ((h - 257) >> 3) & 7, ppu->reg[PPU_REG_TA], pd);
+                break;
+            }
+            BGLoad (ppu, pd);
+            ParNextTile (ppu);
+            if ( h == 256 ) ParNextRow (ppu);
+            break;
+    }
+}
+
+// ------------------------------------------------------------------------
+// CPU interface
+
+// Read registers -> D pads, end of access -> flags, OAM counter, scroll registers, PAR, $2007 memory cycle
+
+// Rendering uses OAM counter: lines 0-239 and pre-render line with BG or sprites on.
+static int Rendering (ContextPPU *ppu)
+{
+    int v = ppu->debug[PPU_DEBUG_V];
+    return NOT(ppu->ctrl[PPU_CTRL_BLACK]) & (v < 240 || v == 261);
+}
+
+// Palette entry at PAR ($3F00-$3FFF).
+static unsigned char * Palette (ContextPPU *ppu)
+{
+    int pal = PAR & 0x1f;
+
+    if ( (pal & 0x13) == 0x10 ) pal &= 0x0f;
+    return &ppu->mem[PPU_PALETTE + pal];
+}
+
+// Data goes through internal data bus, which keeps last value: bits not driven by register read back as it.
+// $2002: overflow, sprite 0 hit, vblank in bits 5-7. $2004: OAM byte at OAM counter (OAM buffer while
+// rendering), sprite attribute bits 2-4 do not exist. $2007: read buffer, palette (bits 0-5) at $3F00-$3FFF.
+void PPUDrive (ContextPPU *ppu)
+{
+    unsigned int d = ppu->bus[PPU_BUS_DB];
+
+    if ( ppu->pad[PPU_nDBE] || !ppu->pad[PPU_RW] ) return;
+    switch (ppu->pad[PPU_RS] & 7) {
+        case 2:
+            d = (d & 0x1f) | ppu->latch[PPU_FF_OFLOW] << 5 | ppu->latch[PPU_FF_SPR0HIT] << 6 | ppu->latch[PPU_FF_VBLANK] << 7;
+            break;
+        case 4:
+            d = Rendering (ppu) ? OB : ppu->mem[PPU_MEM_OAM + (OAMCNT & 0xff)];
+            if ( (OAMCNT & 3) == 2 ) d &= 0xe3;
+            break;
+        case 7:
+            if ( (PAR & 0x3f00) == 0x3f00 ) d = (d & 0xc0) | (*Palette (ppu) & 0x3f);
+            else d = ppu->reg[PPU_REG_RB];
+            break;
+    }
+    ppu->bus[PPU_BUS_DB] = d;
+    ppu->pad[PPU_D] = d;
+}
+
+// Once per step, after control registers. Read keeps D driven while selected (flags may change meanwhile).
+// Register side effects happen once, at end of access: $2002 read clears vblank flag, $2003 write loads
+// OAM counter, $2004 write stores OAM byte and counts up (while rendering it is not stored, and the counter
+// moves to next sprite instead).
+// $2005/$2006 writes load scroll registers in two halves (W toggle, cleared by $2002 read), second $2006
+// write copies them to PAR. $2007 access starts memory cycle (palette is written at once, no cycle); while
+// rendering there is no cycle, PAR moves to next tile and next row instead.
+static void PPU_CPU_ACCESS (ContextPPU *ppu)
+{
+    unsigned int acc = 0, prev = ppu->reg[PPU_REG_ACCESS], d = ppu->bus[PPU_BUS_DB] & 0xff;
+
+    if ( !ppu->pad[PPU_nDBE] ) acc = 0x10 | (ppu->pad[PPU_RW] & 1) << 3 | (ppu->pad[PPU_RS] & 7);
+    if ( acc & 8 ) PPUDrive (ppu);
+    ppu->reg[PPU_REG_ACCESS] = acc;
+    if ( prev == 0 || prev == acc ) return;
+
+    switch (prev & 15) {
+        case 8 | 2:
+            ppu->latch[PPU_FF_VBLANK] = 0;
+            ppu->latch[PPU_FF_W] = 0;
+            break;
+        case 3:
+            OAMCNT = d;
+            break;
+        case 4:
+            if ( Rendering (ppu) ) OAMCNT = (OAMCNT & 3) | ((OAMCNT + 4) & 0xfc);
+            else {
+                ppu->mem[PPU_MEM_OAM + (OAMCNT & 0xff)] = (unsigned char)d;
+                OAMCNT = (OAMCNT + 1) & 0xff;
+            }
+            break;
+        case 5:
+            if ( ppu->latch[PPU_FF_W] ) SCROLL = (SCROLL & ~0x73e0UL) | (d & 7) << 12 | (d >> 3) << 5;     // FV, TV
+            else {
+                SCROLL = (SCROLL & ~0x1fUL) | d >> 3;       // TH
+                ppu->reg[PPU_REG_FH] = d & 7;
+            }
+            ppu->latch[PPU_FF_W] ^= 1;
+            break;
+        case 6:
+            if ( ppu->latch[PPU_FF_W] ) {
+                SCROLL = (SCROLL & ~0xffUL) | d;
+                PAR = SCROLL;
+            }
+            else SCROLL = (SCROLL & 0xff) | (d & 0x3f) << 8;
+            ppu->latch[PPU_FF_W] ^= 1;
+            break;
+        case 7:
+        case 8 | 7:
+            if ( Rendering (ppu) ) {
+                ParNextTile (ppu);
+                ParNextRow (ppu);
+            }
+            else if ( prev & 8 ) {
+                ppu->latch[PPU_FF_RDREQ] = 1;
+                ppu->latch[PPU_FF_VADR] = 0;
+            }
+            else if ( (PAR & 0x3f00) == 0x3f00 ) {
+                *Palette (ppu) = (unsigned char)(d & 0x3f);
+                ParNextAccess (ppu);
+            }
+            else {
+                ppu->reg[PPU_REG_WB] = d;
+                ppu->latch[PPU_FF_WRREQ] = 1;
+                ppu->latch[PPU_FF_VADR] = 0;
+            }
+            break;
+    }
+}
+
+// Once per dot (dot: PCLK high half starts). Vblank flag is set at dot 1 of line 241 and cleared at dot 1 of
+// pre-render line (or by $2002 read). /INT is low while flag is set and enabled by VBL ($2000.7), every step.
+static void PPU_VBLANK (ContextPPU *ppu, int dot)
+{
+    if ( dot && ppu->debug[PPU_DEBUG_H] == 1 ) {
+        if ( ppu->debug[PPU_DEBUG_V] == 241 ) ppu->latch[PPU_FF_VBLANK] = 1;
+        if ( ppu->debug[PPU_DEBUG_V] == 261 ) ppu->latch[PPU_FF_VBLANK] = 0;
+    }
+    ppu->ctrl[PPU_CTRL_nINT] = NAND(ppu->ctrl[PPU_CTRL_VBL], ppu->latch[PPU_FF_VBLANK]);
+}
+
+// ------------------------------------------------------------------------
+// MUX
+
+// Once per dot, palette index of dot to PAL bus. Dots of VIS (H 1-256) put out pixels 0-255, backdrop otherwise.
+// First opaque sprite wins over other sprites, then over opaque background unless its priority bit puts it behind.
+// Sprite 0 hit is opaque pixel of unit 0 over opaque background, not at last pixel.
+static void PPU_MUX (ContextPPU *ppu)
+{
+    unsigned short pix[9];
+    int first, attr, obj, bg, use, hit;
+
+    bg = BGStep (ppu);
+    if ( !ppu->ctrl[PPU_CTRL_VIS] ) {
+        ppu->bus[PPU_BUS_PAL] = 0;
+        return;
+    }
+    first = ObjStep (ppu, pix);
+    attr = ppu->obj_attr[first & 7];
+    obj = (pix[first] != 0) & NOT(ppu->ctrl[PPU_CTRL_CLIP_O]);
+    use = obj & (NOT(attr >> 5) | (bg == 0));
+    ppu->bus[PPU_BUS_PAL] = (bg & (use - 1)) | ((0x10 | (attr & 3) << 2 | pix[first]) & -use);
+    hit = ppu->latch[PPU_FF_OBJ0] & (pix[0] != 0) & NOT(ppu->ctrl[PPU_CTRL_CLIP_O]) & (bg != 0) & (ppu->debug[PPU_DEBUG_H] != 256);
+    ppu->latch[PPU_FF_SPR0HIT] |= hit;
+}
+
+// ------------------------------------------------------------------------
+// Video output
+
+// Composite levels in volts above sync (Docs/PPU/vidout_levels.txt), normalized so black is 0.0 and white 1.0.
+static const float vid_low[4] = { 0.350f, 0.518f, 0.962f, 1.550f };     // colors x0...xC low, xD
+static const float vid_high[4] = { 1.090f, 1.500f, 1.960f, 1.960f };    // colors x0...xC high, x0
+#define VID_SYNC        0.000f
+#define VID_BURST_LOW   0.218f
+#define VID_BURST_HIGH  0.931f
+#define VID_BLACK       0.518f
+#define VID_WHITE       1.960f
+#define VID_EMPHASIS    0.746f      // attenuation of emphasized phases
+#define VID_NORM(v)     (((v) - VID_BLACK) / (VID_WHITE - VID_BLACK))
+
+// Waveforms for 12 chroma phases (Docs/PPU/phases.txt), twice in a row so 8 samples of a dot from any phase are one run.
+// Hue x is high during 6 phases, from phase (12 - x); emphasis attenuates phases of hues 0 (R), 4 (G), 8 (B).
+static float vid_wave[512][24];     // pixel (color + emphasis)
+static float vid_burst[24];
+static volatile long vid_ready;
+
+#define IN_PHASE(hue,phase)     (((hue) + (phase)) % 12 < 6)
+
+static void VideoTables (void)
+{
+    int pix, hue, level, emph, phase;
+    float low, high, v;
+
+    if ( ATOMIC_LOAD (&vid_ready) ) return;
+    SPIN_LOCK (&hv_lock);
+    for (pix=0; pix<512 && !vid_ready; pix++) {
+        hue = pix & 15;
+        level = (pix >> 4) & 3;
+        emph = pix >> 6;
+        if ( hue > 13 ) level = 1;      // xE, xF are black
+        low = vid_low[level];
+        high = vid_high[level];
+        if ( hue == 0 ) low = high;
+        if ( hue > 12 ) high = low;
+        for (phase=0; phase<12; phase++) {
+            v = IN_PHASE(hue, phase) ? high : low;
+            if ( ((emph & 1) && IN_PHASE(0, phase)) || ((emph & 2) && IN_PHASE(4, phase)) || ((emph & 4) && IN_PHASE(8, phase)) ) v *= VID_EMPHASIS;
+            vid_wave[pix][phase] = vid_wave[pix][phase + 12] = VID_NORM(v);
+        }
+    }
+    for (phase=0; phase<12; phase++) {
+        vid_burst[phase] = vid_burst[phase + 12] = VID_NORM(IN_PHASE(8, phase) ? VID_BURST_HIGH : VID_BURST_LOW);
+    }
+    ATOMIC_STORE (&vid_ready, 1);
+    SPIN_UNLOCK (&hv_lock);
+}
+
+static void FrameSwap (PPUFramebuffer *fb)
+{
+    unsigned short *frame = fb->back, *next = NULL;
+    long n;
+
+    (void)ATOMIC_XCHG_PTR (&fb->last, frame);      // full barrier: frame pixels before pointer
+    n = ATOMIC_ADD (&fb->frames, 1) + 1;
+    if ( fb->done ) next = fb->done (fb->opaque, frame, n);
+    if ( next == NULL ) next = frame == &fb->pix[0][0][0] ? &fb->pix[1][0][0] : &fb->pix[0][0][0];
+    fb->back = next;
+    fb->drawn = 0;
+}
+
+// Called once per dot, on first CLK edge of PCLK half that starts it (phase: chroma phase of that edge).
+// Framebuffer takes color of PAL bus for each dot of visible lines (H 1-256 for pixels 0-255, V 0-239), whether
+// rendering is on or not (backdrop). Buffers swap once per frame, on first vblank line.
+// Composite line takes 8 samples per dot: sync, burst, picture (pixel waveform) or black, from H/V outputs.
+static void PPU_VIDEO_OUT (ContextPPU *ppu)
+{
+    PPUFramebuffer *fb = ppu->fb;
+    PPUComposite *cv = ppu->cv;
+    int h = ppu->debug[PPU_DEBUG_H], v = ppu->debug[PPU_DEBUG_V], pal, color, n;
+    float *out, level;
+
+    pal = ppu->bus[PPU_BUS_PAL] & 0x1f;
+    if ( (pal & 0x13) == 0x10 ) pal &= 0x0f;       // $3F10/14/18/1C are $3F00/04/08/0C
+    color = ppu->mem[PPU_PALETTE + pal] & (ppu->ctrl[PPU_CTRL_BW] ? 0x30 : 0x3f);
+    color |= (NOT(ppu->ctrl[PPU_CTRL_nTR]) | NOT(ppu->ctrl[PPU_CTRL_nTG]) << 1 | NOT(ppu->ctrl[PPU_CTRL_nTB]) << 2) << 6;
+
+    if (fb) {
+        if ( v < PPU_HEIGHT ) {
+            if ( h >= 1 && h <= PPU_WIDTH ) {
+                fb->back[v * PPU_WIDTH + h - 1] = (unsigned short)color;
+                fb->drawn = 1;
+            }
+        }
+        else if ( fb->drawn ) FrameSwap (fb);
+    }
+
+    if ( cv == NULL || h >= 341 ) return;
+    if ( h == 0 ) {
+        cv->line = v;
+        cv->phase = ppu->phase;
+    }
+    out = &cv->samples[h * 8];
+    if ( ppu->ctrl[PPU_CTRL_SYNC] || !(ppu->ctrl[PPU_CTRL_BURST] || ppu->ctrl[PPU_CTRL_PICTURE]) ) {
+        level = ppu->ctrl[PPU_CTRL_SYNC] ? VID_NORM(VID_SYNC) : VID_NORM(VID_BLACK);
+        for (n=0; n<8; n++) out[n] = level;
+    }
+    else if ( ppu->ctrl[PPU_CTRL_BURST] ) memcpy (out, &vid_burst[ppu->phase], 8 * sizeof(float));
+    else memcpy (out, &vid_wave[color][ppu->phase], 8 * sizeof(float));
+    ppu->vid = out[0];
+    if ( h == 340 && cv->done ) cv->done (cv->opaque, cv->line, cv->samples, cv->phase);
+}
+
+void PPUSetFramebuffer (ContextPPU *ppu, PPUFramebuffer *fb)
+{
+    if (fb) {
+        memset (fb, 0, sizeof(PPUFramebuffer));
+        fb->back = &fb->pix[1][0][0];
+        fb->last = &fb->pix[0][0][0];
+    }
+    ppu->fb = fb;
+}
+
+void PPUSetComposite (ContextPPU *ppu, PPUComposite *cv, PPULineDone done, void *opaque)
+{
+    VideoTables ();
+    if (cv) {
+        memset (cv, 0, sizeof(PPUComposite));
+        cv->done = done;
+        cv->opaque = opaque;
+    }
+    ppu->cv = cv;
+}
+
+const unsigned short * PPUFrame (PPUFramebuffer *fb, long *frames)
+{
+    if (frames) *frames = ATOMIC_LOAD (&fb->frames);
+    return fb->last;
+}
+
+void PPUSetFrameDone (PPUFramebuffer *fb, PPUFrameDone done, void *opaque)
+{
+    unsigned short *own0 = &fb->pix[0][0][0], *own1 = &fb->pix[1][0][0], *dst;
+
+    if ( done == NULL ) {
+        if ( fb->back != own0 && fb->back != own1 ) {
+            dst = fb->last == own0 ? own1 : own0;
+            memcpy (dst, fb->back, sizeof(fb->pix[0]));
+            fb->back = dst;
+        }
+        if ( fb->last != own0 && fb->last != own1 ) {
+            dst = fb->back == own0 ? own1 : own0;
+            memcpy (dst, fb->last, sizeof(fb->pix[0]));
+            (void)ATOMIC_XCHG_PTR (&fb->last, dst);
+        }
+    }
+    fb->done = done;
+    fb->opaque = opaque;
+}
+
+const float * PPUWaveform (int pix)
+{
+    VideoTables ();
+    return pix < 0 ? vid_burst : vid_wave[pix & 511];
+}
+
+// ------------------------------------------------------------------------
+// Control line event log
+
+// Lines in order of text dump, asserted level.
+static const struct { char ctrl, level; const char *name; } ev_line[PPU_EV_MAX] = {
+    { PPU_CTRL_SCCNT, 1, "SC/CNT" }, { PPU_CTRL_SEV, 1, "S/EV" }, { PPU_CTRL_EEV, 1, "E/EV" },
+    { PPU_CTRL_CLIP_O, 1, "CLIP_O" }, { PPU_CTRL_CLIP_B, 1, "CLIP_B" }, { PPU_CTRL_ZHPOS, 1, "0/HPOS" },
+    { PPU_CTRL_EVAL, 1, "EVAL" }, { PPU_CTRL_IOAM2, 1, "I/OAM2" }, { PPU_CTRL_FNT, 1, "F/NT" },
+    { PPU_CTRL_FAT, 1, "F/AT" }, { PPU_CTRL_PARO, 1, "PAR/O" }, { PPU_CTRL_FTA, 1, "F/TA" },
+    { PPU_CTRL_FTB, 1, "F/TB" }, { PPU_CTRL_nFO, 0, "/FO" }, { PPU_CTRL_VIS, 1, "VIS" },
+    { PPU_CTRL_BLNK, 1, "BLNK" }, { PPU_CTRL_RESCL, 1, "RESCL" }, { PPU_CTRL_PICTURE, 1, "PICTURE" },
+    { PPU_CTRL_SYNC, 1, "SYNC" }, { PPU_CTRL_nFPORCH, 0, "FRPORCH" }, { PPU_CTRL_nBPORCH, 0, "BKPORCH" },
+    { PPU_CTRL_BURST, 1, "BURST" }, { PPU_CTRL_nINT, 0, "/INT" },
+};
+
+#define LOG_MAGIC   "PPUEVLOG"
+
+// Once per dot, on PCLK high. Event only when some line changed; frame counts when V wraps.
+static void PPU_LOG (ContextPPU *ppu)
+{
+    PPUEventLog *log = ppu->log;
+    int h = ppu->debug[PPU_DEBUG_H], v = ppu->debug[PPU_DEBUG_V], n;
+    unsigned long lines = 0;
+    PPUEvent *e;
+
+    if ( h == log->h && v == log->v ) return;
+    if ( v < log->v ) log->frame++;
+    log->h = h;
+    log->v = v;
+
+    for (n=0; n<PPU_EV_MAX; n++) lines |= (unsigned long)(ppu->ctrl[(int)ev_line[n].ctrl] == ev_line[n].level) << n;
+    if ( lines == log->lines && log->head ) return;
+    log->lines = lines;
+    e = &log->ring[log->head++ & (log->size - 1)];
+    e->frame = log->frame;
+    e->v = (unsigned short)v;
+    e->h = (unsigned short)h;
+    e->lines = lines;
+}
+
+int PPULogInit (PPUEventLog *log, unsigned long size)
+{
+    memset (log, 0, sizeof(PPUEventLog));
+    while ( size & (size - 1) ) size &= size - 1;
+    log->size = size ? size : 1;
+    log->ring = (PPUEvent *)malloc (log->size * sizeof(PPUEvent));
+    log->h = log->v = -1;
+    return log->ring != NULL;
+}
+
+void PPULogFree (PPUEventLog *log)
+{
+    free (log->ring);
+    memset (log, 0, sizeof(PPUEventLog));
+}
+
+void PPUSetLog (ContextPPU *ppu, PPUEventLog *log)
+{
+    ppu->log = log;
+}
+
+static void Put32 (unsigned char *p, unsigned long v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned long Get32 (const unsigned char *p)
+{
+    return p[0] | (unsigned long)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+// File: magic, event count, events (frame, V | H << 16, lines), 32-bit little-endian.
+int PPULogSave (PPUEventLog *log, const char *path)
+{
+    unsigned char rec[12];
+    unsigned long n, first = log->head > log->size ? log->head - log->size : 0;
+    PPUEvent *e;
+    FILE *f;
+    int ok;
+
+    f = fopen (path, "wb");
+    if (f == NULL) return 0;
+    Put32 (rec, log->head - first);
+    ok = fwrite (LOG_MAGIC, 1, 8, f) == 8 && fwrite (rec, 1, 4, f) == 4;
+    for (n=first; ok && n<log->head; n++) {
+        e = &log->ring[n & (log->size - 1)];
+        Put32 (rec, e->frame);
+        Put32 (rec + 4, e->v | (unsigned long)e->h << 16);
+        Put32 (rec + 8, e->lines);
+        ok = fwrite (rec, 1, 12, f) == 12;
+    }
+    return fclose (f) == 0 && ok;
+}
+
+static void PrintDot (FILE *out, int h, int v, unsigned long lines)
+{
+    int n;
+
+    fprintf (out, "H:%i V:%i ", h, v);
+    for (n=0; n<PPU_EV_MAX; n++) {
+        if ( (lines >> n) & 1 ) fprintf (out, " %s", ev_line[n].name);
+    }
+    fprintf (out, "\n");
+}
+
+// Lines hold between events, so dots in between are printed with lines of event before them.
+// Dots go H 0...340, V 0...261 (PPU_LINE_SAMPLES / 8 dots, HV_LINES lines).
+int PPULogPrint (const char *path, FILE *out)
+{
+    unsigned char rec[12];
+    unsigned long count, n, frame = 0, lines = 0, next_frame;
+    int h = 0, v = 0, next_h, next_v, started = 0;
+    FILE *f;
+
+    f = fopen (path, "rb");
+    if (f == NULL) return 0;
+    if ( fread (rec, 1, 12, f) != 12 || memcmp (rec, LOG_MAGIC, 8) ) {
+        fclose (f);
+        return 0;
+    }
+    count = Get32 (rec + 8);
+
+    for (n=0; n<count && fread (rec, 1, 12, f) == 12; n++) {
+        next_frame = Get32 (rec);
+        next_v = (int)(Get32 (rec + 4) & 0xffff);
+        next_h = (int)(Get32 (rec + 4) >> 16);
+        while ( started && (frame < next_frame || (frame == next_frame && (v < next_v || (v == next_v && h < next_h)))) ) {
+            PrintDot (out, h, v, lines);
+            if ( ++h == PPU_LINE_SAMPLES / 8 ) {
+                h = 0;
+                if ( ++v == HV_LINES ) {
+                    v = 0;
+                    frame++;
+                }
+            }
+        }
+        frame = next_frame;
+        v = next_v;
+        h = next_h;
+        lines = Get32 (rec + 8);
+        started = 1;
+    }
+    if (started) PrintDot (out, h, v, lines);
+    fclose (f);
+    return 1;
 }
 
 // ------------------------------------------------------------------------
 
 void PPUStep (ContextPPU *ppu)
 {
+    int pclk = PCLK;
+
     PPU_RESET (ppu);
     PPU_CLOCK (ppu);
     PPU_PIXEL_CLOCK (ppu);
-    //PPU_RWDECODE (ppu);
-    //PPU_REGSELECT (ppu);
-    PPU_HV (ppu);
+    PPU_CONTROL_REGS (ppu);
+    PPU_CPU_ACCESS (ppu);
+    PPU_HV_STEP (ppu, 1);
+    PPU_VBLANK (ppu, PCLK && !pclk);
+    if ( PCLK && !pclk ) {
+        PPU_OAM_EVAL (ppu);
+        PPU_SCROLL_REGS (ppu);
+        PPU_MUX (ppu);
+        PPU_ADDR_DECODE (ppu);
+        PPU_VIDEO_OUT (ppu);
+    }
+    else if ( !PCLK && pclk ) PPU_READ (ppu);
+    ppu->phase = ppu->phase == 11 ? 0 : ppu->phase + 1;
+    if ( ppu->log && PCLK ) PPU_LOG (ppu);
+}
+
+// Pixel clock divider latches PCLK0...PCLK3 after last CLK edge of PCLK low / high half (CLK is low then).
+static const char pclk_latch[2][4] = { { 1, 0, 1, 1 }, { 0, 1, 0, 0 } };
+
+int PPUPixelAligned (ContextPPU *ppu)
+{
+    return !RES && ppu->pad[PPU_CLK] == 0 && !memcmp (&ppu->latch[PPU_FF_PCLK0], pclk_latch[PCLK & 1], 4);
+}
+
+// Divider state after the four edges is known: PCLK toggles on first edge and holds, CLK ends as it started.
+// Chroma phase advances by four edges at once, video output takes it in bulk for whole dot. Reset flip/flop sees old RESCL on first edge and new one on the rest.
+int PPUStepPixel (ContextPPU *ppu)
+{
+    int n;
+
+    if ( ppu->pad[PPU_nRES] == 0 ) {       // divider is held, go edge by edge
+        for (n=0; n<4; n++) {
+            PPUStep (ppu);
+            ppu->pad[PPU_CLK] ^= 1;
+        }
+        return PPUPixelAligned (ppu);
+    }
+
+    PPU_RESET (ppu);
+    PCLK = NOT(PCLK);
+    nPCLK = NOT(PCLK);
+    memcpy (&ppu->latch[PPU_FF_PCLK0], pclk_latch[PCLK & 1], 4);
+    ppu->ctrl[PPU_CTRL_nCLK] = (char)ppu->pad[PPU_CLK];     // CLK was high before last edge
+    PPU_CONTROL_REGS (ppu);
+    PPU_CPU_ACCESS (ppu);
+    PPU_HV_STEP (ppu, 4);
+    PPU_VBLANK (ppu, PCLK);
+    for (n=0; n<3; n++) PPU_RESET (ppu);    // rest of edges see new RESCL
+    if (PCLK) {
+        PPU_OAM_EVAL (ppu);
+        PPU_SCROLL_REGS (ppu);
+        PPU_MUX (ppu);
+        PPU_ADDR_DECODE (ppu);
+        PPU_VIDEO_OUT (ppu);
+    }
+    else PPU_READ (ppu);
+    ppu->phase = (ppu->phase + 4) % 12;
+    if ( ppu->log && PCLK ) PPU_LOG (ppu);
+    return 1;
 }
@@ -1,3 +1,6 @@
+#pragma once
+
+#include <stdio.h>
 
 // Pads.
 enum {
@@ -10,7 +13,7 @@ enum {
     PPU_D,          // register data bus
     PPU_RW,         // register data bus direction
     PPU_ALE,        // address latch
-    PPU_AD,         // address/data bus to external PPU memory
+    PPU_AD,         // address/data bus to external PPU memory (bits 8-13: PA8...PA13 while ALE is high)
     PPU_nRD,        // /RD
     PPU_nWR,        // /WR
 };
@@ -46,6 +49,10 @@ enum {
         // control registers output
     PPU_CTRL_OBCLIP, PPU_CTRL_BGCLIP, PPU_CTRL_VBL,         
     PPU_CTRL_nTR, PPU_CTRL_nTG, PPU_CTRL_nTB, PPU_CTRL_BLACK, PPU_CTRL_BW,
+    PPU_CTRL_O816,          // 8x16 sprites
+    PPU_CTRL_OBSEL,         // 8x8 sprite patterns at $1000
+    PPU_CTRL_BGSEL,         // background patterns at $1000
+    PPU_CTRL_I32,           // $2007 access steps PAR by 32
 
     PPU_CTRL_MAX,
 };
@@ -57,12 +64,25 @@ enum {
     PPU_FF_RESET,           // reset flip/flop
     PPU_FF_PCLK0, PPU_FF_PCLK1, PPU_FF_PCLK2, PPU_FF_PCLK3, // pixel clock div/4 latches
     PPU_FF_HC, PPU_FF_VC,     // H/V-counter clear
+    PPU_FF_OAMEV,           // OAM evaluation in progress (S/EV ... E/EV)
+    PPU_FF_COPY,            // copy rest of sprite to secondary OAM
+    PPU_FF_OAMDONE,         // primary OAM counter overflowed (all sprites seen)
+    PPU_FF_SPR0,            // sprite 0 is in secondary OAM
+    PPU_FF_OFLOW,           // sprite overflow
+    PPU_FF_OBJ0,            // sprite 0 is in OAM FIFO unit 0
+    PPU_FF_SPR0HIT,         // sprite 0 hit
+    PPU_FF_VBLANK,          // vblank flag ($2002.7)
+    PPU_FF_W,               // $2005/$2006 write toggle (second write next)
+    PPU_FF_RDREQ, PPU_FF_WRREQ,     // $2007 memory read/write cycle pending
+    PPU_FF_VADR,            // address of $2007 cycle is out, data dot next
 
     PPU_FF_MAX,
 };
 
 // ------------------------------------------------------------------------
 // Registers
+// H/V logic registers come first, up to PPU_REG_VR (H/V table snapshot); render state (OAM evaluation,
+// background fetch) follows and is not part of it.
 
 enum {
     PPU_REG_HIN, PPU_REG_HOUT,          // H-counter
@@ -73,6 +93,16 @@ enum {
     PPU_REG_VROUT,                      // V-select output latches
     PPU_REG_HR,                         // H-select flip/flops
     PPU_REG_VR,                         // V-select flip/flops
+    PPU_REG_OAMCNT,                     // primary OAM counter (sprite n: bits 2-7, byte m: bits 0-1)
+    PPU_REG_OAM2CNT,                    // secondary OAM counter (bit 5: full)
+    PPU_REG_OB,                         // OAM buffer
+    PPU_REG_TA,                         // pattern low byte, until high byte is read
+    PPU_REG_NT, PPU_REG_AT,             // name table byte, attribute of tile (2 bits)
+    PPU_REG_SCROLL,                     // scroll registers: TH bits 0-4, TV 5-9, NTH 10, NTV 11, FV 12-14
+    PPU_REG_FH,                         // fine H scroll
+    PPU_REG_PAR,                        // PAR counters, same layout as scroll registers
+    PPU_REG_ACCESS,                     // CPU access of last step (bit 4: selected, bit 3: RW, bits 0-2: RS)
+    PPU_REG_RB, PPU_REG_WB,             // $2007 read buffer, write data
 
     PPU_REG_MAX,
 };
@@ -110,20 +140,165 @@ enum {
     PPU_DEBUG_MAX,
 };
 
+// ------------------------------------------------------------------------
+// H/V logic modes (PPUSetHV)
+
+enum {
+    PPU_HV_TABLE,           // outputs from precomputed per-frame table, gate logic until table is in sync
+    PPU_HV_GATE,            // gate logic only
+    PPU_HV_VERIFY,          // table and gate logic together, table outputs checked against gates
+};
+
+typedef struct PPUHV
+{
+    int     mode;
+    int     sync;           // outputs come from table (gate registers are stale in PPU_HV_TABLE mode)
+    int     black;          // BLACK of table in use
+    int     line, step;     // table position: line and PPU step since line start (H = 0)
+    int     prev_h;
+    long    errors;         // PPU_HV_VERIFY mismatches
+} PPUHV;
+
+// ------------------------------------------------------------------------
+// Framebuffer
+
+#define PPU_WIDTH   256
+#define PPU_HEIGHT  240
+
+// Finished frame is handed over (n: frames finished so far); returns buffer of PPU_HEIGHT rows of PPU_WIDTH pixels
+// for next frame, NULL: framebuffer's own. Handed frame is still last frame until next one is finished.
+typedef unsigned short * (*PPUFrameDone) (void *opaque, unsigned short *frame, long n);
+
+// Pixel: palette color (bits 0-5), emphasis R, G, B (bits 6-8, inverted /TR, /TG, /TB).
+// PPU draws into back buffer and swaps buffers when vblank starts. Last finished frame stays in place until next
+// swap (one frame later), so consumers use it without copy or lock: read frames, use PPUFrame, and frames
+// unchanged after use means frame was not overwritten meanwhile.
+// PPU alternates own two buffers, unless done callback gives other buffers to draw into.
+typedef struct PPUFramebuffer
+{
+    unsigned short pix[2][PPU_HEIGHT][PPU_WIDTH];
+    unsigned short *back;       // frame in progress
+    unsigned short * volatile last;     // finished frame
+    volatile long frames;       // finished frames, counted after swap
+    int     drawn;              // back buffer has pixels of frame in progress
+    PPUFrameDone    done;       // NULL: no hand-over
+    void    *opaque;
+} PPUFramebuffer;
+
+// ------------------------------------------------------------------------
+// Composite video
+
+#define PPU_LINE_SAMPLES    (341 * 8)       // one sample per CLK edge
+
+// Finished line: V, samples from H = 0, chroma phase (0...11) of first sample.
+typedef void (*PPULineDone) (void *opaque, int line, const float *samples, int phase);
+
+// Composite signal (same levels as vid) of line in progress, written dot by dot.
+typedef struct PPUComposite
+{
+    float   samples[PPU_LINE_SAMPLES];
+    int     line;
+    int     phase;
+    PPULineDone done;
+    void    *opaque;
+} PPUComposite;
+
+// ------------------------------------------------------------------------
+// Control line event log
+
+// Logged lines (bit n of event lines: line asserted).
+enum {
+    PPU_EV_SCCNT, PPU_EV_SEV, PPU_EV_EEV, PPU_EV_CLIP_O, PPU_EV_CLIP_B, PPU_EV_ZHPOS, PPU_EV_EVAL, PPU_EV_IOAM2,
+    PPU_EV_FNT, PPU_EV_FAT, PPU_EV_PARO, PPU_EV_FTA, PPU_EV_FTB, PPU_EV_nFO, PPU_EV_VIS, PPU_EV_BLNK,
+    PPU_EV_RESCL, PPU_EV_PICTURE, PPU_EV_SYNC, PPU_EV_nFPORCH, PPU_EV_nBPORCH, PPU_EV_BURST, PPU_EV_nINT,
+
+    PPU_EV_MAX,
+};
+
+// Lines after transition, at dot (frame, V, H). Lines are sampled once per dot.
+typedef struct PPUEvent
+{
+    unsigned long frame;
+    unsigned short v, h;
+    unsigned long lines;
+} PPUEvent;
+
+// Ring of last events (older are overwritten).
+typedef struct PPUEventLog
+{
+    PPUEvent    *ring;
+    unsigned long   size;       // power of two
+    unsigned long   head;       // events logged
+    unsigned long   frame, lines;
+    int     h, v;               // last dot
+} PPUEventLog;
+
 // ------------------------------------------------------------------------
 // Context.
 
+// Registers and buses are bit-packed words (bit n: line n), 32 bits are enough for all of them. Hot state
+// (control lines, latches, registers, buses, render state) comes first and takes a few cache lines; memories follow.
 typedef struct ContextPPU
 {
-    float    vid;               // video output (composite video, normalized to 1.0)
-    unsigned long pad[12];      // I/O pads and external buses
+    char    ctrl[PPU_CTRL_MAX];      // control lines
     char    latch[PPU_FF_MAX];       // individual latches
-    int     ctrl[PPU_CTRL_MAX];      // control lines
-    char    reg[PPU_REG_MAX][32];  // registers
-    unsigned char mem[256+32+64];    // primary OAM, secondary OAM, palette
-    unsigned long bus[PPU_BUS_MAX][32];  // internal buses
+    unsigned int reg[PPU_REG_MAX];  // registers
+    unsigned int bus[PPU_BUS_MAX];  // internal buses
+    unsigned int pad[12];       // I/O pads and external buses
+    int     phase;              // chroma phase (CLK edges mod 12)
+    PPUHV   hv;                 // H/V logic table state
+    float    vid;               // video output (composite video, normalized to 1.0)
     int     debug[PPU_DEBUG_MAX];    // debug variables
+    unsigned long long oam_range[4];    // primary OAM bytes in Y range of line being evaluated (bit n: byte n)
+    unsigned long long obj_cnt;         // OAM FIFO H-counters (byte n: unit n)
+    unsigned short obj_shift[8];        // OAM FIFO shift registers, 2 bits per pixel, next pixel in bits 14-15
+    unsigned char obj_attr[8];          // OAM FIFO attributes (palette: bits 0-1, behind background: bit 5)
+    unsigned long long bg_shift;        // background shift registers, 4 bits per pixel (attribute and pattern), next pixel in bits 60-63
+    unsigned char mem[256+32+64];    // primary OAM, secondary OAM, palette
+    PPUFramebuffer  *fb;        // NULL: no picture. Not part of PPU state, keep last.
+    PPUComposite    *cv;        // NULL: no composite samples (vid is not updated).
+    PPUEventLog *log;           // NULL: no control line log
 } ContextPPU;
 
 // Emulate single PPU half-clock.
 void PPUStep (ContextPPU *ppu);
+
+// Emulate pixel clock half (4 CLK half-clocks, from edge where PCLK changes) in one call, with same
+// control outputs as PPUStep at end of it. PPU must be PPUPixelAligned. CLK pad is as before the call.
+// Returns 0 if PPU is not aligned after it (/RES holds pixel clock divider), then use PPUStep until aligned.
+int PPUStepPixel (ContextPPU *ppu);
+
+// PPU is at pixel clock edge: next PPUStep changes PCLK.
+int PPUPixelAligned (ContextPPU *ppu);
+
+// CPU register read: register selected by RS drives D pads while /DBE is low and RW is high. Read data path
+// has no clock, so data is there right after pads are set; side effects of read happen on PPU steps
+// ($2007 read buffer is refilled by memory cycle after access).
+void PPUDrive (ContextPPU *ppu);
+
+// Draw into framebuffer (NULL: stop). Buffers are cleared.
+void PPUSetFramebuffer (ContextPPU *ppu, PPUFramebuffer *fb);
+
+// Last finished frame (PPU_HEIGHT rows of PPU_WIDTH pixels), frames finished so far in *frames (may be NULL).
+const unsigned short * PPUFrame (PPUFramebuffer *fb, long *frames);
+
+// Hand finished frames over to done (NULL: stop, frames in consumer buffers are copied back to own buffers).
+void PPUSetFrameDone (PPUFramebuffer *fb, PPUFrameDone done, void *opaque);
+
+// Produce composite samples (NULL: stop), done is called at end of each line.
+void PPUSetComposite (ContextPPU *ppu, PPUComposite *cv, PPULineDone done, void *opaque);
+
+// Composite waveform of pixel (color + emphasis), 12 samples at chroma phases 0...11. pix -1: color burst.
+const float * PPUWaveform (int pix);
+
+// Log of control line transitions (NULL: stop). size: events in ring (rounded down to power of two).
+int PPULogInit (PPUEventLog *log, unsigned long size);
+void PPULogFree (PPUEventLog *log);
+void PPUSetLog (ContextPPU *ppu, PPUEventLog *log);
+
+// Save events to binary file. Print saved log as text, one line per dot with asserted lines. Return 0 on error.
+int PPULogSave (PPUEventLog *log, const char *path);
+int PPULogPrint (const char *path, FILE *out);
+
+// Select H/V logic mode. Gate registers are brought up to date when table mode is left.
+void PPUSetHV (ContextPPU *ppu, int mode);